@@ -13,6 +13,28 @@
 #include <shader_s.h>
 #include "pieces.h"
 #include "grid.h"
+#include "game.h"
+#include "replay.h"
+#include "player.h"
+#include "verify.h"
+#include "bot.h"
+#include "tuner.h"
+#include "perfect.h"
+#include "hint.h"
+#include "vecenv.h"
+#include "dataset.h"
+#include "gridbench.h"
+#include "framebench.h"
+#include "trace.h"
+#include "allocations.h"
+#include "latency.h"
+#include "pacing.h"
+#include "render.h"
+#include "scores.h"
+#include "snapshot.h"
+#include "versus.h"
+#include "spectate.h"
+#include "wall.h"
 
 #include <iostream>
 #include <vector>
@@ -22,14 +44,19 @@
 int SCR_WIDTH = 1366;
 int SCR_HEIGHT = 768;
 bool collapse = false;
-int time;
-bool paused, menu, player_1, options;
+const double BOT_DELAY = 0.02;			// seconds between two inputs of the bot
+const int TICK_RATE = 240;				// frames a second of the main thread with --render-thread
+int fallTime;
+bool paused, menu, player_1, versus, spectating, options, watching, ai, hints;
+FrameBenchmark *frameBench = nullptr;		// --bench-frames, the loop runs the benchmark scenes
+FrameAllocations frameAllocations;			// --no-alloc makes it strict
+InputLatency inputLatency;
+bool latencyOverlay = false;				// F8
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
-void processInput(GLFWwindow *window, PiecePtr p, Grid *g);
+void processInput(GLFWwindow *window, Game *game);
 int initConfig(GLFWwindow *w);
 void initVertexArray(unsigned int *B, unsigned int *A);
-int pop_bag(std::vector<int> *bag, int nth);
 void keyInputCallBack(GLFWwindow* window, int key, int scancode, int action, int mods);
 bool keyInputEvent(int key, int action, int mods);
 void windowResizeCallBack(GLFWwindow* window, int width, int height);
@@ -45,13 +72,68 @@ bool cursorEnterWindowEvent(int entered);
 static void ShowAppControlOverlay(bool *p_open);
 static void ShowAppPointOverlay(float points);
 static void ShowAppPauseOverlay(GLFWwindow* window);
-bool my_comp(glm::vec2 i, glm::vec2 j) { return (i.x > j.x); }
+static bool ShowAppReplayOverlay(ReplayPlayer *player);
+static void ShowAppLatencyOverlay(const InputLatency *latency);
+static void ShowAppVersusOverlay(const Versus *match);
+static bool ShowAppSpectatorOverlay(int *boards, int shown, double cost);
 
-int main()
+int main(int argc, char *argv[])
 {
 	GLFWmonitor* monitor;
 	int displayWidth;
 	int displayHeight;
+	int refreshRate = 60;
+
+	// --trace <file> goes before any other mode, the trace is written when the program ends
+	if (argc > 2 && strcmp(argv[1], "--trace") == 0)
+	{
+		tracePath() = argv[2];
+		Trace::get().enable(true);
+		atexit(dumpTraceAtExit);
+		argc -= 2;
+		argv += 2;
+	}
+	Trace::get().nameThread("main");
+	// --no-alloc [mode]: steady gameplay frames must not allocate, see FrameAllocations
+	if (argc > 1 && strcmp(argv[1], "--no-alloc") == 0)
+	{
+		frameAllocations.strict = true;
+		argc--;
+		argv++;
+	}
+	// --render-thread [mode]: the GL context goes to a thread of its own, see RenderThread
+	bool renderThreaded = false;
+	if (argc > 1 && strcmp(argv[1], "--render-thread") == 0)
+	{
+		renderThreaded = true;
+		argc--;
+		argv++;
+	}
+
+	// headless tools, no window
+	if (argc > 2 && strcmp(argv[1], "--verify") == 0)
+		return verifyReplays(argv[2], argc > 3 ? argv[3] : nullptr);
+	if (argc > 1 && strcmp(argv[1], "--bot") == 0)
+		return benchmarkBot(argc > 2 ? atoi(argv[2]) : 10, argc > 3 ? atoi(argv[3]) : 8, argc > 4 ? atoi(argv[4]) : 3, argc > 5 ? atoi(argv[5]) : 2000, argc > 6 ? atoi(argv[6]) : 1);
+	if (argc > 2 && strcmp(argv[1], "--tune") == 0)
+		return tuneWeights(argv[2], argc > 3 ? atoi(argv[3]) : 100, argc > 4 ? atoi(argv[4]) : 32, argc > 5 ? atoi(argv[5]) : 8, argc > 6 ? atoi(argv[6]) : 1000,
+			argc > 7 ? atoi(argv[7]) : 1, argc > 8 ? atoi(argv[8]) : 1);
+	if (argc > 1 && strcmp(argv[1], "--pc") == 0)
+		return benchmarkPerfectClear(argc > 2 ? atoi(argv[2]) : 20, argc > 3 ? atoi(argv[3]) : 10, argc > 4 ? atoi(argv[4]) : 4, argc > 5 ? atoll(argv[5]) : 1000000,
+			argc > 6 ? atoi(argv[6]) : 0);
+	if (argc > 2 && strcmp(argv[1], "--net") == 0)
+		return benchmarkNetwork(argv[2], argc > 3 ? atoi(argv[3]) : 2, argc > 4 ? atoi(argv[4]) : 8, argc > 5 ? atoi(argv[5]) : 3);
+	if (argc > 1 && strcmp(argv[1], "--env") == 0)
+		return benchmarkEnv(argc > 2 ? atoi(argv[2]) : 64, argc > 3 ? atoi(argv[3]) : 1000, argc > 4 ? atoi(argv[4]) : 0, argc > 5 ? atoi(argv[5]) : 0);
+	if (argc > 2 && strcmp(argv[1], "--export") == 0)
+		return exportSelfPlay(argv[2], argc > 3 ? atoi(argv[3]) : 10, argc > 4 ? atoi(argv[4]) : 1, argc > 5 ? atoi(argv[5]) : 1, argc > 6 ? atoi(argv[6]) : 256, argc > 7 ? atoi(argv[7]) : 2000);
+	if (argc > 1 && strcmp(argv[1], "--bench-grid") == 0)
+		return benchmarkGrid(argc > 2 ? atof(argv[2]) : 0.2, argc > 3 ? argv[3] : nullptr);
+	if (argc > 1 && strcmp(argv[1], "--bench-frames") == 0)
+		frameBench = new FrameBenchmark(argc > 2 ? atoi(argv[2]) : 600, argc > 3 ? argv[3] : nullptr);
+	// the benchmark measures the serial loop
+	if (frameBench != nullptr)
+		renderThreaded = false;
 
 	glfwInit();
 	//glfwWindowHint(GLFW_CLIENT_API, GLFW_OPENGL_API);
@@ -66,24 +148,40 @@ int main()
 #ifdef __APPLE__
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // uncomment this statement to fix compilation on OS X
 #endif
+	// the benchmark needs no monitor: a hidden window, software rendering through EGL or OSMesa if asked
+	if (frameBench != nullptr)
+	{
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+		if (argc > 4 && strcmp(argv[4], "egl") == 0)
+			glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+		else if (argc > 4 && strcmp(argv[4], "osmesa") == 0)
+			glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+	}
 
 	GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Quadris", NULL, NULL);
 	if(initConfig(window) != 0)
 		return -1;
+	if (frameBench != nullptr)
+		installGLCounters();
 	monitor = glfwGetPrimaryMonitor();
-	if (monitor == nullptr)
+	if (monitor == nullptr && frameBench == nullptr)
 		return -1;
-	glfwMaximizeWindow(window);
+	if (frameBench == nullptr)
+		glfwMaximizeWindow(window);
 	if (window == nullptr)
 		return -1;
 	glfwGetFramebufferSize(window, &displayWidth, &displayHeight);
 	glfwGetWindowSize(window, &SCR_WIDTH, &SCR_HEIGHT);
 
-	const auto v = glfwGetVideoMode(monitor);
-	const auto x = (v->width - SCR_WIDTH) >> 1;
-	const auto y = (v->height - SCR_HEIGHT) >> 1;
+	if (frameBench == nullptr)
+	{
+		const auto v = glfwGetVideoMode(monitor);
+		const auto x = (v->width - SCR_WIDTH) >> 1;
+		const auto y = (v->height - SCR_HEIGHT) >> 1;
 
-	glfwSetWindowPos(window, x, y);
+		glfwSetWindowPos(window, x, y);
+		refreshRate = v->refreshRate;
+	}
 	glfwMakeContextCurrent(window);
 	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
 	glfwSetKeyCallback(window, keyInputCallBack);
@@ -115,7 +213,7 @@ int main()
 	ImGui::StyleColorsClassic();
 	// Clear error buffer.
 	while (glGetError() != GL_NO_ERROR);
-	glfwSwapInterval(1);
+	glfwSwapInterval(frameBench != nullptr ? 0 : 1);
 
 	// build and compile our shader zprogram
 	// ------------------------------------
@@ -136,46 +234,73 @@ int main()
 	// pass transformation matrices to the shader
 	shader.setMat4("projection", projection); // note: currently we set the projection matrix each frame, but since the projection matrix rarely changes it's often best practice to set it outside the main loop only once.
 	shader.setMat4("view", view);
+	BoardBatch *batch = new BoardBatch(projection, view, Versus::PLAYERS);
+	BoardWall *wall = new BoardWall();
 
+	// with the render thread the games on this thread are headless, the render thread draws a copy of the one on screen
+	Shader *gameShader = renderThreaded ? nullptr : &shader;
+	Game *game;
 	Grid *g;
-	g = new Grid(shader);
-
-	std::random_device random_rotation, random_type;
-	std::vector<int> bag;
-	for (int i = 0; i < 7; i++)
-		bag.push_back(i);
-
-	PiecePtr currentPiece(new Piece(shader, (Piece::types)pop_bag(&bag, (random_type() % 7)), (Piece::rotation)(random_rotation() % 4)));
-	PiecePtr nextPiece1(new Piece(shader, (Piece::types)pop_bag(&bag, (random_type() % 7)), (Piece::rotation)(random_rotation() % 4)));
-	PiecePtr nextPiece2(new Piece(shader, (Piece::types)pop_bag(&bag, (random_type() % 7)), (Piece::rotation)(random_rotation() % 4)));
-	PiecePtr nextPiece3(new Piece(shader, (Piece::types)pop_bag(&bag, (random_type() % 7)), (Piece::rotation)(random_rotation() % 4)));
-	PiecePtr nextPiece4(new Piece(shader, (Piece::types)pop_bag(&bag, (random_type() % 7)), (Piece::rotation)(random_rotation() % 4)));
-	PiecePtr nextPiece5(new Piece(shader, (Piece::types)pop_bag(&bag, (random_type() % 7)), (Piece::rotation)(random_rotation() % 4)));
-	PiecePtr nextPiece6(new Piece(shader, (Piece::types)pop_bag(&bag, (random_type() % 7)), (Piece::rotation)(random_rotation() % 4)));
-
-	glm::mat4 posicaoNextPiece = glm::mat4(g->getModel());
-	posicaoNextPiece = glm::translate(posicaoNextPiece, glm::vec3(15.5f, 21.0f, -10.0f));
-	nextPiece1->setModel(posicaoNextPiece);
-	posicaoNextPiece = glm::translate(posicaoNextPiece, glm::vec3(0.0f, -4.5f, 0.0f));
-	nextPiece2->setModel(posicaoNextPiece);
-	posicaoNextPiece = glm::translate(posicaoNextPiece, glm::vec3(0.0f, -4.5f, 0.0f));
-	nextPiece3->setModel(posicaoNextPiece);
-	posicaoNextPiece = glm::translate(posicaoNextPiece, glm::vec3(0.0f, -4.5f, 0.0f));
-	nextPiece4->setModel(posicaoNextPiece);
-	posicaoNextPiece = glm::translate(posicaoNextPiece, glm::vec3(0.0f, -4.5f, 0.0f));
-	nextPiece5->setModel(posicaoNextPiece);
-	posicaoNextPiece = glm::translate(posicaoNextPiece, glm::vec3(0.0f, -4.5f, 0.0f));
-	nextPiece6->setModel(posicaoNextPiece);
-
-	g->start(&currentPiece);
-	time = -1;
+	game = new Game(gameShader, Game::newSeed());
+	g = game->g;
+	fallTime = -1;
+
+	Leaderboard leaderboard;
+	leaderboard.load("scores.sco");
+
+	// pick up the game left running last time
+	Snapshot snapshot;
+	SnapshotWriter snapshotWriter("quadris.snp");
+	if (frameBench == nullptr && readSnapshot("quadris.snp", &snapshot) && !snapshot.lost)
+	{
+		// without the replay of the game so far the one kept from here would not verify, the game is played but not archived
+		game->restore(snapshot);
+		if (game->replay.load("quadris.qrp") && game->replay.seed == snapshot.seed)
+		{
+			game->clock = game->replay.getLastTick() / 1000.0;
+			game->archivable = true;
+		}
+		else
+		{
+			game->replay.begin(snapshot.seed, snapshot.level, (unsigned long long)std::time(nullptr));
+			removeSnapshot("quadris.qrp");
+		}
+		fallTime = 0;
+	}
 	
 	float deltaTime;
 	bool control_window = true;
 	paused = false;
 	menu = true;
 	player_1 = false;
+	versus = false;
+	spectating = false;
 	options = false;
+	watching = false;
+	ai = false;
+	hints = false;
+	Bot bot;
+	Replay::action botInputs[MoveGenerator::MAX_INPUTS];
+	int botCount = 0, botNext = 0;
+	double botWait = 0.0;
+	HintEngine hintEngine;
+	HintEngine::Hint hint;
+	unsigned int hintTicket = 0, hintPiece = 0;		// hintTicket: the last post, 0 when no hint is wanted
+	hint.ticket = 0;
+	Replay replay;
+	ReplayPlayer *replayPlayer = nullptr;
+	Versus match;
+	Snapshot versusShown;
+	Spectators spectators;
+	int spectatorBoards = 64;
+	double wallCost = 0.0;		// seconds of CPU the wall takes a frame, smoothed
+	double wallCopy = 0.0;		// seconds the tiles took to go into the last RenderFrame
+	std::vector<std::string> replayFiles;
+	bool was_paused = paused;
+	double last_frame = glfwGetTime(), frame_time;
+	FramePacer pacer;
+	long long frameNumber = 0;
+	FrameBenchmark::scene benchScene = FrameBenchmark::scene::DONE;
 
 	ImGuiIO& io = ImGui::GetIO();
 	//io.Fonts->AddFontDefault();
@@ -184,20 +309,74 @@ int main()
 	//ImFont* font_control = io.Fonts->AddFontFromFileTTF("../../Include/misc/fonts/Roboto-Medium.ttf", 20.0f);
 	//ImFont* font_points = io.Fonts->AddFontFromFileTTF("../../Include/misc/fonts/DroidSans.ttf", 20.0f);
 
+	RenderThread *renderThread = nullptr;
+	Game *onScreen;			// the game the render thread draws this frame, if any
+	Versus *rivals;			// or both boards of the versus match
+	Spectators *crowd;		// or the spectator wall
+	if (renderThreaded)
+	{
+		// ImGui makes its shaders and font texture on the first frame, that has to happen while the context is still here
+		ImGui_ImplOpenGL3_NewFrame();
+		glfwMakeContextCurrent(NULL);
+		renderThread = new RenderThread(window, shader, VAO, batch, wall, 1);
+		pacer.tick(TICK_RATE);
+	}
+
 	// render loop
 	// -----------
 	while (!glfwWindowShouldClose(window))
 	{
+		{
+			TRACE_ZONE("pacing");
+			pacer.wait();
+		}
+		TRACE_ZONE("frame");
+		frameAllocations.begin();
+		// the benchmark decides what is on screen, its games always start from the same seed
+		if (frameBench != nullptr)
+		{
+			benchScene = frameBench->beginFrame();
+			if (benchScene == FrameBenchmark::scene::DONE)
+				break;
+			menu = benchScene != FrameBenchmark::scene::GAMEPLAY;
+			player_1 = !menu;
+			paused = options = watching = ai = hints = false;
+			if (player_1 && (frameBench->first() || g->lost))
+			{
+				delete game;
+				game = new Game(gameShader, frameBench->seed());
+				g = game->g;
+				fallTime = -1;
+			}
+		}
 		deltaTime = 1000.0f / ImGui::GetIO().Framerate;
+		frame_time = glfwGetTime() - last_frame;
+		last_frame += frame_time;
 		// Pool and handle events.
 		glfwPollEvents();
 		// Start the Dear ImGui frame
-		ImGui_ImplOpenGL3_NewFrame();
+		if (renderThread == nullptr)
+			ImGui_ImplOpenGL3_NewFrame();
 		ImGui_ImplGlfw_NewFrame();
 		ImGui::NewFrame();		
 
-		glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		if (renderThread == nullptr)
+		{
+			glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		}
+		onScreen = nullptr;
+		rivals = nullptr;
+		crowd = nullptr;
+
+		// the bot plans again from wherever the piece is when it comes back
+		if (menu || paused || !ai)
+		{
+			botCount = botNext = 0;
+			botWait = 0.0;
+		}
+		if (menu || paused || !hints || ai)
+			hintTicket = 0;
 
 		static bool demo = false;
 		if (demo)
@@ -208,14 +387,15 @@ int main()
 			if (ImGui::Begin("MENU", NULL, ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_NoFocusOnAppearing | ImGuiWindowFlags_NoNav))
 			{
 				ImGui::PushItemWidth(-1);
-				ImGui::SetWindowSize(ImVec2(400, 215));
-				if (time != -1)
+				ImGui::SetWindowSize(ImVec2(400, 291));
+				if (fallTime != -1)
 				{
-					ImGui::SetWindowSize(ImVec2(400, 253));
+					ImGui::SetWindowSize(ImVec2(400, 329));
 					if (ImGui::Button("CONTINUAR", ImVec2(ImGui::GetWindowSize().x - 15.0f, 0.0f)))
 					{
 						ImGui::CloseCurrentPopup();
 						player_1 = true;
+						versus = false;
 						paused = true;
 						menu = false;
 					}
@@ -223,7 +403,7 @@ int main()
 				if (ImGui::Button("NOVO JOGO", ImVec2(ImGui::GetWindowSize().x - 15.0f, 0.0f)))
 				{
 					ImGui::CloseCurrentPopup();
-					if(time != -1)
+					if(fallTime != -1)
 						ImGui::OpenPopup("CERTEZA?");
 					else
 						ImGui::OpenPopup("NICK?");
@@ -236,39 +416,14 @@ int main()
 
 					if (ImGui::Button("SIM", ImVec2(ImGui::GetWindowSize().x / 2.0f - 15.0f, 0.0f)))
 					{
-						g->saveScore();
-						delete g;
-						g = new Grid(shader);
-
-						while (!bag.empty())
-							bag.pop_back();
-						for (int i = 0; i < 7; i++)
-							bag.push_back(i);
-
-						currentPiece = new Piece(shader, (Piece::types)pop_bag(&bag, (random_type() % 7)), (Piece::rotation)(random_rotation() % 4));
-						nextPiece1 = new Piece(shader, (Piece::types)pop_bag(&bag, (random_type() % 7)), (Piece::rotation)(random_rotation() % 4));
-						nextPiece2 = new Piece(shader, (Piece::types)pop_bag(&bag, (random_type() % 7)), (Piece::rotation)(random_rotation() % 4));
-						nextPiece3 = new Piece(shader, (Piece::types)pop_bag(&bag, (random_type() % 7)), (Piece::rotation)(random_rotation() % 4));
-						nextPiece4 = new Piece(shader, (Piece::types)pop_bag(&bag, (random_type() % 7)), (Piece::rotation)(random_rotation() % 4));
-						nextPiece5 = new Piece(shader, (Piece::types)pop_bag(&bag, (random_type() % 7)), (Piece::rotation)(random_rotation() % 4));
-						nextPiece6 = new Piece(shader, (Piece::types)pop_bag(&bag, (random_type() % 7)), (Piece::rotation)(random_rotation() % 4));
-
-						glm::mat4 posicaoNextPiece = glm::mat4(g->getModel());
-						posicaoNextPiece = glm::translate(posicaoNextPiece, glm::vec3(15.5f, 21.0f, -10.0f));
-						nextPiece1->setModel(posicaoNextPiece);
-						posicaoNextPiece = glm::translate(posicaoNextPiece, glm::vec3(0.0f, -4.5f, 0.0f));
-						nextPiece2->setModel(posicaoNextPiece);
-						posicaoNextPiece = glm::translate(posicaoNextPiece, glm::vec3(0.0f, -4.5f, 0.0f));
-						nextPiece3->setModel(posicaoNextPiece);
-						posicaoNextPiece = glm::translate(posicaoNextPiece, glm::vec3(0.0f, -4.5f, 0.0f));
-						nextPiece4->setModel(posicaoNextPiece);
-						posicaoNextPiece = glm::translate(posicaoNextPiece, glm::vec3(0.0f, -4.5f, 0.0f));
-						nextPiece5->setModel(posicaoNextPiece);
-						posicaoNextPiece = glm::translate(posicaoNextPiece, glm::vec3(0.0f, -4.5f, 0.0f));
-						nextPiece6->setModel(posicaoNextPiece);
-
-						g->start(&currentPiece);
-						time = -1;
+						game->saveScore(&leaderboard);
+						game->archive("replays");
+						removeSnapshot("quadris.snp");
+						removeSnapshot("quadris.qrp");
+						delete game;
+						game = new Game(gameShader, Game::newSeed());
+						g = game->g;
+						fallTime = -1;
 
 						ImGui::OpenPopup("NICK?");
 						ImGui::CloseCurrentPopup();
@@ -295,8 +450,9 @@ int main()
 					if (ImGui::Button("JOGAR", ImVec2(ImGui::GetWindowSize().x / 2.0f - 15.0f, 0.0f)))
 					{
 						ImGui::CloseCurrentPopup();
-						g->setName(buf);
+						game->setName(buf);
 						player_1 = true;
+						versus = false;
 						paused = true;
 						menu = false;
 					}
@@ -310,51 +466,88 @@ int main()
 				}
 				if (ImGui::Button("2 JOGADORES", ImVec2(ImGui::GetWindowSize().x - 15.0f, 0.0f)))
 				{
-					/*ImGui::CloseCurrentPopup();
+					ImGui::CloseCurrentPopup();
+					match.start(Game::newSeed(), g->getLevel(), glfwGetTime());
 					player_1 = false;
+					versus = true;
 					paused = true;
-					menu = false;*/
+					menu = false;
+				}
+				if (ImGui::Button("ESPECTAR", ImVec2(ImGui::GetWindowSize().x - 15.0f, 0.0f)))
+				{
+					ImGui::CloseCurrentPopup();
+					spectators.start(spectatorBoards, "replays");
+					player_1 = false;
+					versus = false;
+					spectating = true;
+					menu = false;
 				}
-				if (ImGui::Button("TOPPERS", ImVec2(ImGui::GetWindowSize().x - 15.0f, 0.0f)))
+				if (ImGui::Button("REPLAYS", ImVec2(ImGui::GetWindowSize().x - 15.0f, 0.0f)))
+				{
+					ImGui::CloseCurrentPopup();
+					listReplays("replays", &replayFiles);
+					ImGui::OpenPopup("REPLAYS");
+				}
+				if (ImGui::BeginPopupModal("REPLAYS", NULL, ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoResize))
+				{
+					ImGui::SetWindowFocus();
+					ImGui::SetWindowSize(ImVec2(500, 600));
+					for (int i = (int)replayFiles.size() - 1; i >= 0; i--)
+					{
+						if (ImGui::Selectable(replayFiles[i].c_str()) && replay.load(("replays/" + replayFiles[i]).c_str()))
+						{
+							delete replayPlayer;
+							replayPlayer = new ReplayPlayer(gameShader, &replay);
+							watching = true;
+							menu = false;
+							ImGui::CloseCurrentPopup();
+						}
+					}
+					ImGui::Separator();
+					if (ImGui::Button("VOLTAR", ImVec2(ImGui::GetWindowSize().x - 30.0f, 0.0f)))
+					{
+						ImGui::CloseCurrentPopup();
+					}
+					ImGui::EndPopup();
+				}
+				if (ImGui::Button("TOPPERS", ImVec2(ImGui::GetWindowSize().x - 15.0f, 0.0f))
+					|| (benchScene == FrameBenchmark::scene::TOPPERS && !ImGui::IsPopupOpen("TOPPERS")))
 				{
 					ImGui::CloseCurrentPopup();
 					ImGui::OpenPopup("TOPPERS");
 				}
 				if (ImGui::BeginPopupModal("TOPPERS", NULL, ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoResize))
 				{
-					std::ifstream sf;
-					char buf[500][64];
-					int index, buf_index = 0;
-					std::vector<glm::vec2> vector_points;
-					std::vector<char*> vector_nicks;
-					sf.open("scores.sco", std::ifstream::in);
+					static int toppers_window = (int)Leaderboard::window::ALL_TIME;
+					static int toppers_level = Leaderboard::ALL_LEVELS;
 
 					ImGui::SetWindowFocus();
 					ImGui::SetWindowSize(ImVec2(500, 600));
 
-					while (!sf.eof())
+					ImGui::RadioButton("HOJE", &toppers_window, (int)Leaderboard::window::DAILY);
+					ImGui::SameLine();
+					ImGui::RadioButton("SEMANA", &toppers_window, (int)Leaderboard::window::WEEKLY);
+					ImGui::SameLine();
+					ImGui::RadioButton("SEMPRE", &toppers_window, (int)Leaderboard::window::ALL_TIME);
+					ImGui::RadioButton("TODOS", &toppers_level, Leaderboard::ALL_LEVELS);
+					for (int l = 0; l < Leaderboard::LEVELS; l++)
 					{
-						sf.getline(buf[buf_index], 64);
-						for (index = 0; buf[buf_index][index] != '\0' && buf[buf_index][index] != ';'; index++);
-						if (index < 2)
-							continue;
-						buf[buf_index][index] = '\0';
-						vector_points.push_back(glm::vec2(atoi(&buf[buf_index][index + 1]), buf_index));
-						vector_nicks.push_back(buf[buf_index++]);
+						char label[8] = { 'L', 'V', ' ', (char)('0' + l), '\0' };
+						ImGui::SameLine();
+						ImGui::RadioButton(label, &toppers_level, l);
 					}
-					std::sort(vector_points.begin(), vector_points.end(), my_comp);
-					
+
+					const std::vector<int>& ranking = leaderboard.view((Leaderboard::window)toppers_window, toppers_level, (long long)std::time(nullptr));
 					ImGui::Columns(2, NULL, NULL);
-					for (std::vector<glm::vec2>::iterator it = vector_points.begin(); it != vector_points.end(); it++)
+					for (std::vector<int>::const_iterator it = ranking.begin(); it != ranking.end(); it++)
 					{
 						if (ImGui::GetColumnIndex() == 0)
 							ImGui::Separator();
-						ImGui::Text("%s", vector_nicks.at(it->y));
+						ImGui::Text("%s", leaderboard.at(*it).name);
 						ImGui::NextColumn();
-						ImGui::Text("%d", (int)it->x);
+						ImGui::Text("%d", leaderboard.at(*it).points);
 						ImGui::NextColumn();
 					}
-					sf.close();
 					ImGui::Columns(1);
 
 					ImGui::Separator();
@@ -381,17 +574,41 @@ int main()
 			ImGui::SetNextWindowPosCenter();
 			if (ImGui::Begin("ESCOLHAS", NULL, ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_NoFocusOnAppearing | ImGuiWindowFlags_NoNav))
 			{
-				static int level = g->getLevel();
-				ImGui::SetWindowSize(ImVec2(400, 105));
+				// the pacer of a render thread only keeps the tick, what the screen does is the swap interval of the thread
+				static int level = g->getLevel(), botWidth = bot.width, botDepth = bot.depth, fpsCap = pacer.getCap(),
+					pacing = renderThread != nullptr ? (int)(renderThread->swapInterval == 0 ? FramePacer::mode::UNCAPPED : FramePacer::mode::VSYNC) : (int)pacer.getMode();
+				ImGui::SetWindowSize(ImVec2(400, 233));
 				ImGui::SliderInt("LEVEL", &level, 0, 5);
+				ImGui::SliderInt("IA LARGURA", &botWidth, 1, Bot::MAX_WIDTH);
+				ImGui::SliderInt("IA PROFUNDIDADE", &botDepth, 1, Bot::MAX_DEPTH);
+				if (renderThread != nullptr)
+				{
+					// there is no late read of the keys nor a cap on the render thread, only vsync on or off
+					bool vsync = pacing != (int)FramePacer::mode::UNCAPPED;
+					if (ImGui::Checkbox("VSYNC", &vsync))
+						pacing = (int)(vsync ? FramePacer::mode::VSYNC : FramePacer::mode::UNCAPPED);
+				}
+				else
+				{
+					// BAIXA LATENCIA reads the keys as late as the next vblank allows, SEM LIMITE turns vsync off
+					ImGui::Combo("QUADROS", &pacing, "VSYNC\0BAIXA LATENCIA\0SEM LIMITE\0\0");
+					ImGui::SliderInt("LIMITE FPS", &fpsCap, 0, 500, fpsCap == 0 ? "SEM LIMITE" : "%d");
+				}
 				ImGui::PushItemWidth(-1);
 				if (ImGui::Button("SALVAR", ImVec2(ImGui::GetWindowSize().x / 2.0f - 15.0f, 0.0f)))
 				{
 					ImGui::CloseCurrentPopup();
 					menu = true;
 					options = false;
-					g->setLevel(level);
-					time = (int)(g->scale * glfwGetTime());
+					game->setLevel(level);
+					bot.setWidth(botWidth);
+					bot.setDepth(botDepth);
+					// the simulation keeps its tick with the render thread, only vsync goes there
+					if (renderThread != nullptr)
+						renderThread->swapInterval = pacing == (int)FramePacer::mode::UNCAPPED ? 0 : 1;
+					else
+						pacer.set((FramePacer::mode)pacing, fpsCap, refreshRate);
+					fallTime = (int)(g->scale * glfwGetTime());
 				}
 				ImGui::SameLine(0, 15.0f);
 				if (ImGui::Button("CANCELAR", ImVec2(ImGui::GetWindowSize().x / 2.0f - 15.0f, 0.0f)))
@@ -400,11 +617,40 @@ int main()
 					menu = true;
 					options = false;
 					level = g->getLevel();
+					botWidth = bot.width;
+					botDepth = bot.depth;
+					if (renderThread != nullptr)
+						pacing = (int)(renderThread->swapInterval == 0 ? FramePacer::mode::UNCAPPED : FramePacer::mode::VSYNC);
+					else
+						pacing = (int)pacer.getMode();
+					fpsCap = pacer.getCap();
 				}
 				ImGui::PopItemWidth();
 			}
 			ImGui::End();
 		}
+		else if (watching)
+		{
+			ImGui::PushFont(font_tetris);
+			ShowAppPointOverlay(replayPlayer->game->g->getPoints());
+			ImGui::PopFont();
+
+			replayPlayer->advance(frame_time);
+			if (!ShowAppReplayOverlay(replayPlayer))
+			{
+				delete replayPlayer;
+				replayPlayer = nullptr;
+				watching = false;
+				menu = true;
+			}
+			else if (renderThread != nullptr)
+				onScreen = replayPlayer->game;
+			else
+			{
+				glBindVertexArray(VAO);
+				replayPlayer->game->draw(shader);
+			}
+		}
 		else if(player_1)
 		{
 			if (control_window)
@@ -432,39 +678,14 @@ int main()
 					ImGui::PushItemWidth(-1);
 					if (ImGui::Button("MENU", ImVec2(ImGui::GetWindowSize().x - 15.0f, 0.0f)))
 					{
-						g->saveScore();
-						delete g;
-						g = new Grid(shader);
-
-						while(!bag.empty())
-							bag.pop_back();
-						for (int i = 0; i < 7; i++)
-							bag.push_back(i);
-
-						currentPiece = new Piece(shader, (Piece::types)pop_bag(&bag, (random_type() % 7)), (Piece::rotation)(random_rotation() % 4));
-						nextPiece1 = new Piece(shader, (Piece::types)pop_bag(&bag, (random_type() % 7)), (Piece::rotation)(random_rotation() % 4));
-						nextPiece2 = new Piece(shader, (Piece::types)pop_bag(&bag, (random_type() % 7)), (Piece::rotation)(random_rotation() % 4));
-						nextPiece3 = new Piece(shader, (Piece::types)pop_bag(&bag, (random_type() % 7)), (Piece::rotation)(random_rotation() % 4));
-						nextPiece4 = new Piece(shader, (Piece::types)pop_bag(&bag, (random_type() % 7)), (Piece::rotation)(random_rotation() % 4));
-						nextPiece5 = new Piece(shader, (Piece::types)pop_bag(&bag, (random_type() % 7)), (Piece::rotation)(random_rotation() % 4));
-						nextPiece6 = new Piece(shader, (Piece::types)pop_bag(&bag, (random_type() % 7)), (Piece::rotation)(random_rotation() % 4));
-
-						glm::mat4 posicaoNextPiece = glm::mat4(g->getModel());
-						posicaoNextPiece = glm::translate(posicaoNextPiece, glm::vec3(15.5f, 21.0f, -10.0f));
-						nextPiece1->setModel(posicaoNextPiece);
-						posicaoNextPiece = glm::translate(posicaoNextPiece, glm::vec3(0.0f, -4.5f, 0.0f));
-						nextPiece2->setModel(posicaoNextPiece);
-						posicaoNextPiece = glm::translate(posicaoNextPiece, glm::vec3(0.0f, -4.5f, 0.0f));
-						nextPiece3->setModel(posicaoNextPiece);
-						posicaoNextPiece = glm::translate(posicaoNextPiece, glm::vec3(0.0f, -4.5f, 0.0f));
-						nextPiece4->setModel(posicaoNextPiece);
-						posicaoNextPiece = glm::translate(posicaoNextPiece, glm::vec3(0.0f, -4.5f, 0.0f));
-						nextPiece5->setModel(posicaoNextPiece);
-						posicaoNextPiece = glm::translate(posicaoNextPiece, glm::vec3(0.0f, -4.5f, 0.0f));
-						nextPiece6->setModel(posicaoNextPiece);
-
-						g->start(&currentPiece);
-						time = -1;
+						game->saveScore(&leaderboard);
+						game->archive("replays");
+						removeSnapshot("quadris.snp");
+						removeSnapshot("quadris.qrp");
+						delete game;
+						game = new Game(gameShader, Game::newSeed());
+						g = game->g;
+						fallTime = -1;
 
 						ImGui::CloseCurrentPopup();
 						paused = false;
@@ -483,43 +704,39 @@ int main()
 			{
 				// input
 				// -----
-				processInput(window, currentPiece, g);
+				TRACE_ZONE("simulate");
+				game->clock += frame_time;
+				if (ai)
+				{
+					// the bot goes one input at a time, its FALLs take the place of gravity
+					game->assisted = true;
+					botWait += frame_time;
+					while (botWait >= BOT_DELAY && !g->lost)
+					{
+						botWait -= BOT_DELAY;
+						if (botNext == botCount)
+						{
+							botCount = bot.plan(game, botInputs);
+							botNext = 0;
+							if (botCount == 0)
+								break;
+						}
+						game->apply(botInputs[botNext++]);
+					}
+					fallTime = (int)(g->scale * glfwGetTime());
+				}
+				else
+					processInput(window, game);
 
 				// render
 				// ------
-				if ((g->endgame && g->change && glfwGetTime() - g->ENDGAME >= 0.6f) || collapse)
+				if (!ai && ((g->endgame && g->change && glfwGetTime() - g->ENDGAME >= 0.6f) || collapse))
 				{
-					//time = (int)(g->scale * glfwGetTime());
-					g->change = false;
-					g->fallAllTheWay();
-					g->change = false;
-					g->endgame = false;
-					g->lineComplete();
-					currentPiece.~PiecePtr();
-					currentPiece = nextPiece1;
-					nextPiece1 = nextPiece2;
-					nextPiece2 = nextPiece3;
-					nextPiece3 = nextPiece4;
-					nextPiece4 = nextPiece5;
-					nextPiece5 = nextPiece6;
-					if (!g->lose())
-					{
-						g->start(&currentPiece);
-						nextPiece6 = new Piece(shader, (Piece::types)pop_bag(&bag, (random_type() % 7)), (Piece::rotation)(random_rotation() % 4));
-						glm::mat4 posicaoNextPiece = glm::mat4(g->getModel());
-						posicaoNextPiece = glm::translate(posicaoNextPiece, glm::vec3(15.5f, 21.0f, -10.0f));
-						nextPiece1->setModel(posicaoNextPiece);
-						posicaoNextPiece = glm::translate(posicaoNextPiece, glm::vec3(0.0f, -4.5f, 0.0f));
-						nextPiece2->setModel(posicaoNextPiece);
-						posicaoNextPiece = glm::translate(posicaoNextPiece, glm::vec3(0.0f, -4.5f, 0.0f));
-						nextPiece3->setModel(posicaoNextPiece);
-						posicaoNextPiece = glm::translate(posicaoNextPiece, glm::vec3(0.0f, -4.5f, 0.0f));
-						nextPiece4->setModel(posicaoNextPiece);
-						posicaoNextPiece = glm::translate(posicaoNextPiece, glm::vec3(0.0f, -4.5f, 0.0f));
-						nextPiece5->setModel(posicaoNextPiece);
-						posicaoNextPiece = glm::translate(posicaoNextPiece, glm::vec3(0.0f, -4.5f, 0.0f));
-						nextPiece6->setModel(posicaoNextPiece);
-					}
+					//fallTime = (int)(g->scale * glfwGetTime());
+					unsigned long long before = g->getHash();
+					game->apply(collapse ? Replay::action::HARD_DROP : Replay::action::LOCK);
+					if (collapse)
+						inputLatency.consumed(GLFW_KEY_I, g->getHash() != before, glfwGetTime());
 				}
 
 				if (!g->endgame && g->change)				// pea deu coliso embaixo e no estava previamente no endgame
@@ -530,49 +747,229 @@ int main()
 				else if (g->endgame && !g->change)		// pea estava no endgame mas mudou de ideia sobre a coliso
 					g->endgame = false;
 
-				if ((int)(g->scale * glfwGetTime()) > time || g->scaleBack)
+				if (!ai && ((int)(g->scale * glfwGetTime()) > fallTime || g->scaleBack))
 				{
 					if (g->scaleBack)
 						g->scaleBack = false;
-					time = (int)(g->scale * glfwGetTime());
-					g->fall();
+					fallTime = (int)(g->scale * glfwGetTime());
+					game->apply(Replay::action::FALL);
+				}
+
+				// every new piece asks for a hint, it is drawn once the engine answers
+				if (hints && !ai && !g->lost)
+				{
+					if (hintTicket == 0 || game->pieces != hintPiece)
+					{
+						hintTicket = hintEngine.post(game);
+						hintPiece = game->pieces;
+					}
+					hintEngine.take(&hint);
 				}
 			}
 			if (collapse)
 			{
-				time = (int)(g->scale * glfwGetTime());
+				fallTime = (int)(g->scale * glfwGetTime());
 				collapse = false;
 			}
 
 			// render boxes
-			glBindVertexArray(VAO);
-			g->draw(shader);
-			nextPiece1->draw(shader);
-			nextPiece2->draw(shader);
-			nextPiece3->draw(shader);
-			nextPiece4->draw(shader);
-			nextPiece5->draw(shader);
-			nextPiece6->draw(shader);
+			if (renderThread != nullptr)
+				onScreen = game;
+			else
+			{
+				glBindVertexArray(VAO);
+				game->draw(shader);
+				if (hintTicket != 0 && hint.ticket == hintTicket)
+					g->drawHint(shader, hint.cells.x, hint.cells.y);
+			}
 		}
+		else if (versus)
+		{
+			ImGui::PushFont(font_tetris);
+			ShowAppVersusOverlay(&match);
+			ImGui::PopFont();
+
+			if (paused)
+				ShowAppPauseOverlay(window);
+			else if (match.finished)
+			{
+				ImGui::SetNextWindowPosCenter();
+				if (ImGui::Begin("FIM", NULL, ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoNav))
+				{
+					ImGui::SetWindowSize(ImVec2(400, 170));
 
-		// glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-		// -------------------------------------------------------------------------------
-		ImGui::Render();
-		glfwGetFramebufferSize(window, &displayWidth, &displayHeight);
-		glViewport(0, 0, displayWidth, displayHeight);
-		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-		glfwSwapBuffers(window);
-		
+					ImGui::SetCursorPosX((ImGui::GetWindowSize().x - 170) / 2.0f - 15.0f);
+					ImGui::Text(match.winner < 0 ? "EMPATE!\n\n" : (match.winner == 0 ? "JOGADOR 1 VENCEU!\n\n" : "JOGADOR 2 VENCEU!\n\n"));
+					ImGui::PushItemWidth(-1);
+					if (ImGui::Button("REVANCHE", ImVec2(ImGui::GetWindowSize().x - 15.0f, 0.0f)))
+						match.start(Game::newSeed(), g->getLevel(), glfwGetTime());
+					ImGui::SetItemDefaultFocus();
+					if (ImGui::Button("MENU", ImVec2(ImGui::GetWindowSize().x - 15.0f, 0.0f)))
+					{
+						versus = false;
+						menu = true;
+					}
+					ImGui::PopItemWidth();
+				}
+				ImGui::End();
+			}
+			else
+			{
+				TRACE_ZONE("simulate");
+				match.update(window, frame_time, glfwGetTime(), &inputLatency);
+			}
+
+			// both boards and their previews in one batch
+			if (renderThread != nullptr)
+				rivals = &match;
+			else
+				match.draw(batch, &versusShown);
+		}
+		else if (spectating)
+		{
+			{
+				TRACE_ZONE("simulate");
+				spectators.update(frame_time);
+			}
+
+			// every board in one draw, every label in one pass, the cost is measured to show it stays flat
+			// with the render thread it is the labels here, the copy of the tiles of the last frame and its last draw there
+			double started = glfwGetTime();
+			ImVec2 display = ImGui::GetIO().DisplaySize;
+			if (display.y > 0.0f)
+				spectators.labels(WallLayout::fit(spectators.count(), display.x / display.y), display);
+			if (renderThread != nullptr)
+				crowd = &spectators;
+			else
+			{
+				glfwGetFramebufferSize(window, &displayWidth, &displayHeight);
+				wall->draw(spectators.getTiles(), spectators.count(), displayWidth, displayHeight);
+			}
+			double spent = glfwGetTime() - started;
+			if (renderThread != nullptr)
+				spent += wallCopy + renderThread->wallSeconds;
+			wallCost = 0.95 * wallCost + 0.05 * spent;
+
+			int boards = spectatorBoards;
+			if (!ShowAppSpectatorOverlay(&spectatorBoards, spectators.count(), wallCost))
+			{
+				spectators.stop();
+				spectating = false;
+				menu = true;
+			}
+			else if (spectatorBoards != boards)
+				spectators.start(spectatorBoards, "replays");
+		}
+
+		if (latencyOverlay)
+			ShowAppLatencyOverlay(&inputLatency);
+
+		if (renderThread != nullptr)
+		{
+			// hand the frame over, the render thread draws the newest one whenever it is free
+			TRACE_ZONE("publish");
+			ImGui::Render();
+			RenderFrame &f = renderThread->frame();
+			glfwGetFramebufferSize(window, &f.width, &f.height);
+			f.boards = rivals != nullptr ? Versus::PLAYERS : (onScreen != nullptr ? 1 : 0);
+			if (rivals != nullptr)
+				for (int i = 0; i < Versus::PLAYERS; i++)
+				{
+					rivals->players[i].game->snapshot(&f.states[i]);
+					f.places[i] = Versus::place(i);
+				}
+			else if (onScreen != nullptr)
+				onScreen->snapshot(&f.states[0]);
+			f.wallBoards = crowd != nullptr ? crowd->count() : 0;
+			if (crowd != nullptr)
+			{
+				double started = glfwGetTime();
+				f.wall.resize(f.wallBoards);
+				memcpy(f.wall.data(), crowd->getTiles(), f.wallBoards * sizeof(WallTile));
+				wallCopy = glfwGetTime() - started;
+			}
+			f.hint = onScreen == game && hintTicket != 0 && hint.ticket == hintTicket;
+			for (int i = 0; f.hint && i < 4; i++)
+			{
+				f.hintX[i] = hint.cells.x[i];
+				f.hintY[i] = hint.cells.y[i];
+			}
+			f.capture(ImGui::GetDrawData());
+			inputLatency.published(renderThread->publish());
+			RenderThread::Presented presented;
+			if (renderThread->presented(&presented))
+				inputLatency.shown(presented.frame, presented.submitted, presented.swapped);
+		}
+		else
+		{
+			// glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
+			// -------------------------------------------------------------------------------
+			{
+				TRACE_ZONE("ImGui render");
+				ImGui::Render();
+				glfwGetFramebufferSize(window, &displayWidth, &displayHeight);
+				glViewport(0, 0, displayWidth, displayHeight);
+				ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+			}
+			if (frameBench != nullptr)
+				frameBench->submitted();
+			pacer.submitting();
+			double submitted = glfwGetTime();
+			inputLatency.published(frameNumber);
+			{
+				TRACE_ZONE("glfwSwapBuffers");
+				glfwSwapBuffers(window);
+				pacer.swapped();
+			}
+			inputLatency.shown(frameNumber++, submitted, glfwGetTime());
+			if (frameBench != nullptr)
+				frameBench->endFrame();
+		}
+
+		if (paused != was_paused)
+		{
+			if (paused && fallTime != -1 && !g->lost)
+			{
+				game->snapshot(&snapshot);
+				snapshotWriter.write(snapshot);
+				if (game->archivable)
+					game->replay.save("quadris.qrp");
+			}
+			was_paused = paused;
+		}
+		frameAllocations.end(!menu && !options && !watching && !paused && (player_1 ? !g->lost : versus && !match.finished));
+	}
+	// the context comes back for the clean up
+	if (renderThread != nullptr)
+	{
+		delete renderThread;
+		glfwMakeContextCurrent(window);
+	}
+	// a game still running is kept for next time instead of being scored, the benchmark keeps nothing
+	if (frameBench != nullptr)
+		frameBench->report();
+	else if (fallTime != -1 && !g->lost)
+	{
+		game->snapshot(&snapshot);
+		snapshotWriter.write(snapshot);
+		if (game->archivable)
+			game->replay.save("quadris.qrp");
+		snapshotWriter.wait();
+	}
+	else
+	{
+		game->saveScore(&leaderboard);
+		game->archive("replays");
+		removeSnapshot("quadris.snp");
+		removeSnapshot("quadris.qrp");
 	}
-	g->saveScore();
-	delete g;
-	currentPiece.~PiecePtr();
-	nextPiece1.~PiecePtr();
-	nextPiece2.~PiecePtr();
-	nextPiece3.~PiecePtr();
-	nextPiece4.~PiecePtr();
-	nextPiece5.~PiecePtr();
-	nextPiece6.~PiecePtr();
+	if (frameBench == nullptr)
+		inputLatency.log("latency.log");
+	delete game;
+	delete replayPlayer;
+	delete frameBench;
+	delete batch;
+	delete wall;
 
 	// optional: de-allocate all resources once they've outlived their purpose:
 	// ------------------------------------------------------------------------
@@ -585,57 +982,79 @@ int main()
 	return 0;
 }
 
+// the keys of the benchmark script while it runs, the keyboard otherwise
+static int keyState(GLFWwindow *window, int key)
+{
+	return frameBench != nullptr ? frameBench->key(key) : glfwGetKey(window, key);
+}
+
+// a move asked by a key, its press is measured once the board changed (see InputLatency)
+static void applyKey(Game *game, int key, Replay::action a)
+{
+	unsigned long long before = game->g->getHash();
+	game->apply(a);
+	inputLatency.consumed(key, game->g->getHash() != before, glfwGetTime());
+}
+
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
 // ---------------------------------------------------------------------------------------------------------
-void processInput(GLFWwindow *window, PiecePtr p, Grid *g)
+void processInput(GLFWwindow *window, Game *game)
 {
+	Grid *g = game->g;
 	static bool key_a_release = true, key_d_release = true, key_i_release = true, key_o_release = true, key_p_release = true;
 
-	if (glfwGetKey(window, GLFW_KEY_A) == GLFW_RELEASE)
+	if (keyState(window, GLFW_KEY_A) == GLFW_RELEASE)
 		key_a_release = true;
-	if (glfwGetKey(window, GLFW_KEY_D) == GLFW_RELEASE)
+	if (keyState(window, GLFW_KEY_D) == GLFW_RELEASE)
 		key_d_release = true;
-	if (glfwGetKey(window, GLFW_KEY_I) == GLFW_RELEASE)
+	if (keyState(window, GLFW_KEY_I) == GLFW_RELEASE)
 		key_i_release = true;
-	if (glfwGetKey(window, GLFW_KEY_O) == GLFW_RELEASE)
+	if (keyState(window, GLFW_KEY_O) == GLFW_RELEASE)
 		key_o_release = true;
-	if (glfwGetKey(window, GLFW_KEY_P) == GLFW_RELEASE)
+	if (keyState(window, GLFW_KEY_P) == GLFW_RELEASE)
 		key_p_release = true;
 
-	if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS && key_a_release)
+	if (keyState(window, GLFW_KEY_A) == GLFW_PRESS && key_a_release)
 	{
-		g->translate(false);
+		applyKey(game, GLFW_KEY_A, Replay::action::LEFT);
 		key_a_release = false;
 		g->ENDGAME = glfwGetTime();
 	}
-	if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+	if (keyState(window, GLFW_KEY_S) == GLFW_PRESS)
+	{
+		if (g->scale != g->fastScale)
+			game->softDrop(true);
 		g->scale = g->fastScale;
+	}
 	else
 	{
 		if (g->scale == g->fastScale)
+		{
 			g->scaleBack = true;
+			game->softDrop(false);
+		}
 		g->scale = g->normalScale;
 	}
-	if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS && key_d_release)
+	if (keyState(window, GLFW_KEY_D) == GLFW_PRESS && key_d_release)
 	{
-		g->translate(true);
+		applyKey(game, GLFW_KEY_D, Replay::action::RIGHT);
 		key_d_release = false;
 		g->ENDGAME = glfwGetTime();
 	}
-	if (glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS && key_i_release)
+	if (keyState(window, GLFW_KEY_I) == GLFW_PRESS && key_i_release)
 	{
 		key_i_release = false;
 		collapse = true;
 	}
-	if (glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS && key_o_release)
+	if (keyState(window, GLFW_KEY_O) == GLFW_PRESS && key_o_release)
 	{
-		g->rotate(true);
+		applyKey(game, GLFW_KEY_O, Replay::action::ROTATE_CW);
 		g->ENDGAME = glfwGetTime();
 		key_o_release = false;
 	}
-	if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS && key_p_release)
+	if (keyState(window, GLFW_KEY_P) == GLFW_PRESS && key_p_release)
 	{
-		g->rotate(false);
+		applyKey(game, GLFW_KEY_P, Replay::action::ROTATE_CCW);
 		g->ENDGAME = glfwGetTime();
 		key_p_release = false;
 	}
@@ -647,7 +1066,9 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
 	// make sure the viewport matches the new window dimensions; note that width and 
 	// height will be significantly larger than specified on retina displays.
-	glViewport(0, 0, width, height);
+	// with --render-thread the context is not here, the render thread sets the viewport every frame
+	if (glfwGetCurrentContext() == window)
+		glViewport(0, 0, width, height);
 }
 
 int initConfig(GLFWwindow *w)
@@ -703,24 +1124,12 @@ void initVertexArray(unsigned int *B, unsigned int *A)
 	glEnableVertexAttribArray(1);
 }
 
-int pop_bag(std::vector<int> *bag, int nth)
-{
-	int chosen, index = nth % bag->size(), temp;
-	chosen = temp = bag->at(index);
-	bag->at(index) = bag->back();
-	bag->at(bag->size() - 1) = temp;
-	bag->pop_back();
-	if (bag->empty())
-		for (int i = 0; i < 7; i++)
-			bag->push_back(i);
-	return chosen;
-}
-
 void keyInputCallBack(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
 	static bool key_esc_release = true;
 	if (action == GLFW_PRESS)
 	{
+		inputLatency.pressed(key, glfwGetTime());
 		if (mods == GLFW_MOD_ALT && key == GLFW_KEY_F4)
 		{
 			glfwSetWindowShouldClose(window, GL_TRUE);
@@ -732,6 +1141,34 @@ void keyInputCallBack(GLFWwindow* window, int key, int scancode, int action, int
 			key_esc_release = false;
 			return;
 		}
+		if (key == GLFW_KEY_B && player_1 && !menu && !paused)
+		{
+			ai = !ai;
+			return;
+		}
+		if (key == GLFW_KEY_H && player_1 && !menu && !paused)
+		{
+			hints = !hints;
+			return;
+		}
+		if (key == GLFW_KEY_F8)
+		{
+			latencyOverlay = !latencyOverlay;
+			return;
+		}
+		// F9 starts recording the trace, the next F9 writes it
+		if (key == GLFW_KEY_F9)
+		{
+			Trace &trace = Trace::get();
+			if (trace.enabled())
+			{
+				trace.enable(false);
+				trace.dumpLater(tracePath() != nullptr ? tracePath() : "quadris.trace.json");
+			}
+			else
+				trace.enable(true);
+			return;
+		}
 	}
 	if (action == GLFW_RELEASE)
 	{
@@ -831,6 +1268,8 @@ static void ShowAppControlOverlay(bool *p_open)
 		ImGui::Text("A, S e D movimentam o quadro");
 		ImGui::Text("O e P rotacionam o quadro");
 		ImGui::Text("I desce o quadro");
+		ImGui::Text(ai ? "B desliga a IA" : "B liga a IA");
+		ImGui::Text(hints ? "H esconde a dica" : "H mostra a dica");
 	}
 	ImGui::End();
 }
@@ -882,4 +1321,111 @@ static void ShowAppPauseOverlay(GLFWwindow* window)
 		ImGui::PopItemWidth();
 	}
 	ImGui::End();
-}
\ No newline at end of file
+}
+
+// returns false when the player asked to leave
+static bool ShowAppReplayOverlay(ReplayPlayer *player)
+{
+	bool open = true;
+	const float DISTANCE = 10.0f;
+	ImVec2 window_pos = ImVec2(ImGui::GetIO().DisplaySize.x / 2.0f, ImGui::GetIO().DisplaySize.y - DISTANCE);
+	ImVec2 window_pos_pivot = ImVec2(0.5f, 1.0f);
+	ImGui::SetNextWindowPos(window_pos, ImGuiCond_Always, window_pos_pivot);
+	ImGui::SetNextWindowBgAlpha(0.6f); // Transparent background
+	if (ImGui::Begin("REPLAY", NULL, ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_NoFocusOnAppearing | ImGuiWindowFlags_NoNav))
+	{
+		ImGui::SetWindowSize(ImVec2(600, 105));
+		float seconds = (float)(player->position() / 1000.0);
+		ImGui::PushItemWidth(-1);
+		if (ImGui::SliderFloat("##tempo", &seconds, 0.0f, player->length() / 1000.0f, "%.1f s"))
+			player->seek(seconds * 1000.0);
+		ImGui::PopItemWidth();
+		if (ImGui::Button(player->playing ? "PAUSA" : "PLAY", ImVec2(100.0f, 0.0f)))
+			player->playing = !player->playing;
+		ImGui::SameLine();
+		ImGui::RadioButton("1x", &player->speed, 1);
+		ImGui::SameLine();
+		ImGui::RadioButton("10x", &player->speed, 10);
+		ImGui::SameLine();
+		ImGui::RadioButton("MAX", &player->speed, ReplayPlayer::MAX_SPEED);
+		ImGui::SameLine();
+		if (ImGui::Button("VOLTAR", ImVec2(100.0f, 0.0f)))
+			open = false;
+	}
+	ImGui::End();
+	return open;
+}
+
+// histogram of the last inputs, from the key press to the swap that showed them
+static void ShowAppLatencyOverlay(const InputLatency *latency)
+{
+	const float DISTANCE = 10.0f;
+	ImVec2 window_pos = ImVec2(DISTANCE, ImGui::GetIO().DisplaySize.y - DISTANCE);
+	ImVec2 window_pos_pivot = ImVec2(0.0f, 1.0f);
+	ImGui::SetNextWindowPos(window_pos, ImGuiCond_Always, window_pos_pivot);
+	ImGui::SetNextWindowBgAlpha(0.6f); // Transparent background
+	if (ImGui::Begin("LATENCIA", NULL, ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_NoFocusOnAppearing | ImGuiWindowFlags_NoNav))
+	{
+		const LatencyHistogram &submit = latency->submit, &present = latency->present;
+		float counts[LatencyHistogram::BUCKETS];
+		for (int b = 0; b < LatencyHistogram::BUCKETS; b++)
+			counts[b] = (float)present.counts[b];
+		ImGui::SetWindowSize(ImVec2(420, 190));
+		ImGui::Text("%lld entradas", present.samples);
+		ImGui::Text("ATE O ENVIO  p50 %3.0f  p95 %3.0f  p99 %3.0f ms", submit.percentile(0.5), submit.percentile(0.95), submit.percentile(0.99));
+		ImGui::Text("ATE A TELA   p50 %3.0f  p95 %3.0f  p99 %3.0f ms", present.percentile(0.5), present.percentile(0.95), present.percentile(0.99));
+		ImGui::PlotHistogram("##latencia", counts, LatencyHistogram::BUCKETS, 0, "0 - 100 ms", 0.0f, FLT_MAX, ImVec2(400, 80));
+	}
+	ImGui::End();
+}
+
+// points, garbage waiting and wins of each player over its side of the screen, with its keys
+static void ShowAppVersusOverlay(const Versus *match)
+{
+	const float DISTANCE = 10.0f;
+	static const char *titles[Versus::PLAYERS] = { "JOGADOR 1", "JOGADOR 2" };
+	for (int i = 0; i < Versus::PLAYERS; i++)
+	{
+		const Versus::Player &p = match->players[i];
+		ImVec2 window_pos = ImVec2(i == 0 ? DISTANCE : ImGui::GetIO().DisplaySize.x - DISTANCE, DISTANCE);
+		ImVec2 window_pos_pivot = ImVec2(i == 0 ? 0.0f : 1.0f, 0.0f);
+		ImGui::SetNextWindowPos(window_pos, ImGuiCond_Always, window_pos_pivot);
+		ImGui::SetNextWindowBgAlpha(0.3f); // Transparent background
+		if (ImGui::Begin(titles[i], NULL, ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_NoFocusOnAppearing | ImGuiWindowFlags_NoNav))
+		{
+			ImGui::SetWindowSize(ImVec2(330, 140));
+			ImGui::TextColored(ImVec4(0.0f, 1.0f, 0.0f, 1.0f), "%.0f", p.game != nullptr ? p.game->g->getPoints() : 0.0f);
+			ImGui::Text("LIXO %d  VITORIAS %d", p.pending, p.wins);
+			ImGui::TextWrapped("%s", p.keys.text);
+		}
+		ImGui::End();
+	}
+}
+
+// how many boards the spectator wall has, how many it found and what drawing them costs the CPU each frame
+static bool ShowAppSpectatorOverlay(int *boards, int shown, double cost)
+{
+	static const int counts[] = { 4, 16, 64, 144, 256 };
+	bool open = true;
+	const float DISTANCE = 10.0f;
+	ImVec2 window_pos = ImVec2(ImGui::GetIO().DisplaySize.x / 2.0f, ImGui::GetIO().DisplaySize.y - DISTANCE);
+	ImVec2 window_pos_pivot = ImVec2(0.5f, 1.0f);
+	ImGui::SetNextWindowPos(window_pos, ImGuiCond_Always, window_pos_pivot);
+	ImGui::SetNextWindowBgAlpha(0.6f); // Transparent background
+	if (ImGui::Begin("ESPECTADORES", NULL, ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_NoFocusOnAppearing | ImGuiWindowFlags_NoNav))
+	{
+		ImGui::SetWindowSize(ImVec2(600, 105));
+		for (int i = 0; i < 5; i++)
+		{
+			char label[8];
+			snprintf(label, 8, "%d", counts[i]);
+			ImGui::RadioButton(label, boards, counts[i]);
+			ImGui::SameLine();
+		}
+		if (ImGui::Button("VOLTAR", ImVec2(100.0f, 0.0f)))
+			open = false;
+		ImGui::Text("%d JOGOS  CPU %.2f ms", shown, cost * 1000.0);
+	}
+	ImGui::End();
+	return open;
+}
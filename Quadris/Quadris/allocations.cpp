@@ -0,0 +1,60 @@
+#include "allocations.h"
+
+#include <new>
+
+// replaces the global operator new and delete of Quadris.exe, see allocations.h
+
+void *operator new(std::size_t size)
+{
+	AllocationCounter &a = allocations();
+	void *p = malloc(size == 0 ? 1 : size);
+	if (p == nullptr)
+		throw std::bad_alloc();
+	a.count++;
+	a.bytes += (long long)size;
+	return p;
+}
+
+void *operator new[](std::size_t size)
+{
+	return operator new(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+	AllocationCounter &a = allocations();
+	void *p = malloc(size == 0 ? 1 : size);
+	if (p != nullptr)
+	{
+		a.count++;
+		a.bytes += (long long)size;
+	}
+	return p;
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &t) noexcept
+{
+	return operator new(size, t);
+}
+
+void operator delete(void *p) noexcept
+{
+	if (p != nullptr)
+		allocations().frees++;
+	free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+	operator delete(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+	operator delete(p);
+}
+
+void operator delete[](void *p, std::size_t) noexcept
+{
+	operator delete(p);
+}
@@ -0,0 +1,70 @@
+#ifndef __allocations_h
+#define __allocations_h
+
+#include <cstdio>
+#include <cstdlib>
+
+// every operator new and delete of the program is counted on the thread that made it
+// the replacements live in allocations.cpp; where it is not linked in (QuadrisEnv) the counters just stay at zero
+struct AllocationCounter
+{
+	long long count, bytes, frees;
+};
+
+inline AllocationCounter &allocations()
+{
+	static thread_local AllocationCounter counter = { 0, 0, 0 };
+	return counter;
+}
+
+// allocations of each frame of the render loop, on the render thread
+// a steady frame is a gameplay frame once the game has been running for WARMUP frames in a row
+// Quadris.exe --no-alloc [mode]: a steady frame that allocates stops the program right there,
+// so the call is still on the stack in the debugger
+class FrameAllocations
+{
+public:
+	static const int WARMUP = 120;			// first spawns, first hint, first trace buffer of the thread
+
+	FrameAllocations()
+	{
+		strict = false;
+		frame = steady = 0;
+		start = last = allocations();
+	}
+
+	void begin()
+	{
+		start = allocations();
+	}
+
+	// steady: the frame was gameplay, anything else starts the warm up over
+	void end(bool gameplay)
+	{
+		const AllocationCounter &now = allocations();
+		last.count = now.count - start.count;
+		last.bytes = now.bytes - start.bytes;
+		last.frees = now.frees - start.frees;
+		steady = gameplay ? steady + 1 : 0;
+		frame++;
+		if (strict && steady > WARMUP && last.count > 0)
+		{
+			fprintf(stderr, "frame %lld allocated %lld times (%lld bytes) in steady gameplay\n", frame, last.count, last.bytes);
+			abort();
+		}
+	}
+
+	// what the frame that just ended allocated
+	const AllocationCounter &frameAllocations() const
+	{
+		return last;
+	}
+
+	bool strict;
+
+private:
+	long long frame, steady;
+	AllocationCounter start, last;
+};
+
+#endif // !__allocations_h
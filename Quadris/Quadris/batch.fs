@@ -0,0 +1,20 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoord;
+in vec3 Color;
+flat in int Kind;
+
+// texture samplers
+uniform sampler2D text1;
+uniform sampler2D text2;
+
+void main()
+{
+	if(Kind == 2)
+		FragColor = vec4(Color, 1.0f);
+	else if(Kind == 1)
+		FragColor = mix(texture(text1, TexCoord), vec4(Color, 1.0f), 0.5);
+	else
+		FragColor = texture(text2, TexCoord);
+}
\ No newline at end of file
@@ -0,0 +1,224 @@
+#ifndef __batch_h
+#define __batch_h
+
+#include "shader_s.h"
+#include "grid.h"
+#include "pieces.h"
+#include "snapshot.h"
+#include "trace.h"
+
+#include <vector>
+
+// draws whole boards, preview included, with one instanced draw for the cells of all of them and one for the shadows,
+// where Game::draw makes a glDrawArrays per cell: every frame begin(), add() each board, then draw()
+// a board comes as a Snapshot, so the render thread draws the same way from what the main thread published
+class BoardBatch
+{
+public:
+	static const int PREVIEW = 6;			// queue[1..PREVIEW] of a snapshot, as Game shows them
+	static const int CELLS = Snapshot::LINES * Snapshot::COLUMNS + PREVIEW * 4;
+
+	// one cell: center and size in world space, color and kind, as batch.vs reads it
+	struct Instance
+	{
+		float x, y, z, size;
+		float r, g, b, kind;
+	};
+
+	// with the GL context current; boards is how many boards a frame usually has, more only cost a reallocation
+	BoardBatch(glm::mat4 projection, glm::mat4 view, int boards) : shader("batch.vs", "batch.fs")
+	{
+		static const float square[] = {
+			// positions          // texture coords
+			 0.5f,  0.5f, 0.0f,   1.0f, 1.0f,
+			 0.5f, -0.5f, 0.0f,   1.0f, 0.0f,
+			-0.5f, -0.5f, 0.0f,   0.0f, 0.0f,
+			-0.5f, -0.5f, 0.0f,   0.0f, 0.0f,
+			-0.5f,  0.5f, 0.0f,   0.0f, 1.0f,
+			 0.5f,  0.5f, 0.0f,   1.0f, 1.0f
+		};
+
+		cells.reserve(boards * CELLS);
+		outlines.reserve(boards * 4);
+		capacity = 0;
+		for (int t = 0; t < 7; t++)
+		{
+			Piece p((Piece::types)t, Piece::rotation::R0);
+			for (int i = 0; i < 4; i++)
+				shapes[t][i] = p.positions[i];
+		}
+
+		glGenVertexArrays(1, &vao);
+		glGenBuffers(1, &quad);
+		glGenBuffers(1, &instances);
+		glBindVertexArray(vao);
+		glBindBuffer(GL_ARRAY_BUFFER, quad);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(square), square, GL_STATIC_DRAW);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
+		glEnableVertexAttribArray(1);
+		glBindBuffer(GL_ARRAY_BUFFER, instances);
+		glEnableVertexAttribArray(2);
+		glVertexAttribDivisor(2, 1);
+		glEnableVertexAttribArray(3);
+		glVertexAttribDivisor(3, 1);
+		glBindVertexArray(0);
+
+		text1 = Piece::loadTexture();
+		text2 = loadTexture("resources/textures/transparent.jpg");
+
+		int previous;
+		glGetIntegerv(GL_CURRENT_PROGRAM, &previous);
+		shader.use();
+		shader.setMat4("projection", projection);
+		shader.setMat4("view", view);
+		shader.setInt("text1", 0);
+		shader.setInt("text2", 1);
+		glUseProgram(previous);
+	}
+
+	~BoardBatch()
+	{
+		glDeleteVertexArrays(1, &vao);
+		glDeleteBuffers(1, &quad);
+		glDeleteBuffers(1, &instances);
+		glDeleteTextures(1, &text2);
+		glDeleteProgram(shader.ID);
+	}
+
+	void begin()
+	{
+		cells.clear();
+		outlines.clear();
+	}
+
+	// place goes before the model of the grid: where the board is and how big, the same scale on every axis
+	void add(const Snapshot &s, const glm::mat4 &place)
+	{
+		glm::mat4 model = glm::translate(place, glm::vec3(-5.0f, -10.0f, 0.0f));
+		float size = glm::length(glm::vec3(place[0]));
+
+		// the 20 lines on screen always, the ones above only where a piece is
+		for (int l = 0; l < Snapshot::LINES; l++)
+			for (int c = 0; c < Snapshot::COLUMNS; c++)
+			{
+				int kind = s.getCell(l, c);
+				if (kind != 0)
+					push(&cells, model, glm::vec3(0.5f + c, 0.5f + l, 0.0f), size, colorOf(kind), FILLED);
+				else if (l < 20)
+					push(&cells, model, glm::vec3(0.5f + c, 0.5f + l, 0.0f), size, glm::vec3(0.0f), EMPTY);
+			}
+
+		glm::vec3 falling = Piece::colorOf((Piece::types)s.queue[0][0]);
+		for (int i = 0; i < 4; i++)
+			if (s.shadow[i][0] != s.piece[i][0] || s.shadow[i][1] != s.piece[i][1])
+				push(&outlines, model, glm::vec3(0.5f + s.shadow[i][1], 0.5f + s.shadow[i][0], 0.0f), size, falling, OUTLINE);
+
+		// the preview goes where Game::setModels puts it
+		glm::mat4 next = glm::translate(model, glm::vec3(15.5f, 21.0f, -10.0f));
+		for (int i = 1; i <= PREVIEW; i++)
+		{
+			int t = s.queue[i][0];
+			for (int j = 0; j < 4; j++)
+				push(&cells, next, shapes[t][j], size, Piece::colorOf((Piece::types)t), FILLED);
+			next = glm::translate(next, glm::vec3(0.0f, -4.5f, 0.0f));
+		}
+	}
+
+	// every board added since begin(), the program bound before is bound again after
+	void draw()
+	{
+		TRACE_ZONE("BoardBatch::draw");
+		int n = (int)cells.size(), m = (int)outlines.size();
+		if (n + m == 0)
+			return;
+
+		// the buffer is orphaned every frame, the driver gives a fresh one instead of waiting for the last draw
+		glBindBuffer(GL_ARRAY_BUFFER, instances);
+		capacity = n + m > capacity ? n + m : capacity;
+		glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(Instance), NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, n * sizeof(Instance), cells.data());
+		if (m > 0)
+			glBufferSubData(GL_ARRAY_BUFFER, n * sizeof(Instance), m * sizeof(Instance), outlines.data());
+
+		int previous;
+		glGetIntegerv(GL_CURRENT_PROGRAM, &previous);
+		shader.use();
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, text1);
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, text2);
+		glBindVertexArray(vao);
+		attributes(0);
+		glDrawArraysInstanced(GL_TRIANGLES, 0, 6, n);
+		if (m > 0)
+		{
+			attributes(n);
+			glLineWidth(3.5f);
+			glDrawArraysInstanced(GL_LINE_LOOP, 0, 6, m);
+		}
+		glBindVertexArray(0);
+		glUseProgram(previous);
+	}
+
+	// a 2D texture as Grid makes them, for the textures the grids do not share
+	static unsigned int loadTexture(const char *path)
+	{
+		unsigned int texture;
+		int width, height, nrChannels;
+		unsigned char *data;
+
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		stbi_set_flip_vertically_on_load(false);
+		data = stbi_load(path, &width, &height, &nrChannels, 0);
+		if (data)
+		{
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
+			glGenerateMipmap(GL_TEXTURE_2D);
+		}
+		else
+		{
+			std::cout << "Failed to load texture" << std::endl;
+		}
+		stbi_image_free(data);
+		return texture;
+	}
+
+private:
+	enum kind { EMPTY, FILLED, OUTLINE };
+
+	static glm::vec3 colorOf(int kind)
+	{
+		if (kind == Snapshot::GARBAGE)
+			return Grid::garbageColor();
+		return Piece::colorOf((Piece::types)(kind - 1));
+	}
+
+	static void push(std::vector<Instance> *to, const glm::mat4 &model, glm::vec3 center, float size, glm::vec3 color, kind k)
+	{
+		glm::vec4 p = model * glm::vec4(center, 1.0f);
+		Instance i = { p.x, p.y, p.z, size, color.r, color.g, color.b, (float)k };
+		to->push_back(i);
+	}
+
+	// the instance attributes start at instance first of the buffer
+	void attributes(int first)
+	{
+		glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)(first * sizeof(Instance)));
+		glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)(first * sizeof(Instance) + 4 * sizeof(float)));
+	}
+
+	Shader shader;
+	unsigned int vao, quad, instances, text1, text2;
+	int capacity;						// instances the buffer on the GPU holds
+	std::vector<Instance> cells, outlines;
+	glm::vec3 shapes[7][4];				// the blocks of each piece around its center, from Piece
+};
+
+#endif // !__batch_h
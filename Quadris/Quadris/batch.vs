@@ -0,0 +1,21 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoord;
+// one instance per cell: center and size in world space, then color and kind (0 empty, 1 filled, 2 outline)
+layout (location = 2) in vec4 aPlace;
+layout (location = 3) in vec4 aColor;
+
+out vec2 TexCoord;
+out vec3 Color;
+flat out int Kind;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+    gl_Position = projection * view * vec4(aPlace.xyz + aPos * aPlace.w, 1.0f);
+    TexCoord = vec2(aTexCoord.x, 1.0 - aTexCoord.y);
+	Color = aColor.rgb;
+	Kind = int(aColor.a);
+}
\ No newline at end of file
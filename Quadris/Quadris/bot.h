@@ -0,0 +1,469 @@
+#ifndef __bot_h
+#define __bot_h
+
+#include "evaluator.h"
+#include "game.h"
+#include "movegen.h"
+#include "network.h"
+#include "replay.h"
+#include "trace.h"
+#include "zobrist.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <float.h>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// plays by itself: a beam search over the falling piece and the preview queue
+// every level places one more piece of the queue, only the best width boards go on to the next level
+// boards are scored by Evaluator, all the children of a board in one batch, the weights are public so they can be tuned
+// a Network given to the bot scores them instead, the lines cleared still count with weights.lines
+// a level is expanded by threads sharing a transposition table keyed by the board zobrist and the queue position,
+// so a board reached again by another order of the same pieces is dropped instead of evaluated twice
+// and the boards of the previous search are not evaluated again
+class Bot
+{
+public:
+	static const int MAX_WIDTH = 64;
+	static const int MAX_DEPTH = Game::PREVIEW + 1;		// the falling piece and every preview
+
+	typedef Evaluator::Weights Weights;
+
+	Weights weights;
+	int width, depth;
+	long long evaluations, duplicates, reused;		// boards evaluated, dropped as already seen, taken from an older search
+	Cells chosen;									// where the inputs of the last plan put the piece
+	const std::atomic<bool> *cancel;				// when set, checked between levels and plan gives up with 0
+	const Network *network;							// scores the boards instead of the weights when set
+
+	// threads <= 0 uses every core
+	Bot(int w = 8, int d = 3, int threads = 1)
+	{
+		setWidth(w);
+		setDepth(d);
+		if (threads <= 0)
+			threads = (int)std::thread::hardware_concurrency();
+		if (threads <= 0)
+			threads = 1;
+		evaluations = duplicates = reused = 0;
+		root = new MoveGenerator();
+		table = new TranspositionTable();
+		evaluated = weights;
+		cancel = nullptr;
+		network = nullptr;
+		scored = nullptr;
+		quit = false;
+		job = 0;
+		pending = 0;
+		for (int i = 0; i < threads; i++)
+			workers.push_back(new Worker());
+		for (int i = 1; i < threads; i++)
+			pool.push_back(std::thread(&Bot::work, this, i));
+	}
+
+	~Bot()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quit = true;
+		}
+		wake.notify_all();
+		for (unsigned int i = 0; i < pool.size(); i++)
+			pool[i].join();
+		for (unsigned int i = 0; i < workers.size(); i++)
+			delete workers[i];
+		delete root;
+		delete table;
+	}
+
+	int threads()
+	{
+		return (int)workers.size();
+	}
+
+	void setWidth(int w)
+	{
+		width = w < 1 ? 1 : (w > MAX_WIDTH ? MAX_WIDTH : w);
+	}
+
+	void setDepth(int d)
+	{
+		depth = d < 1 ? 1 : (d > MAX_DEPTH ? MAX_DEPTH : d);
+	}
+
+	// the inputs for the falling piece of game, out must hold MoveGenerator::MAX_INPUTS
+	// returns how many, 0 when there is nowhere to go
+	int plan(Game *game, Replay::action *out)
+	{
+		TRACE_ZONE("Bot::plan");
+		int best = -1;
+		float bestScore = -FLT_MAX;
+		if (game->g->lost || root->generate(game->g) == 0)
+			return 0;
+		// values in the table were computed with the old weights
+		if (memcmp(&evaluated, &weights, sizeof(Weights)) != 0 || scored != network)
+		{
+			table->clear();
+			evaluated = weights;
+			scored = network;
+		}
+		table->newSearch();
+		evaluator.weights = weights;
+		base = game->pieces;
+
+		State start;
+		game->g->getBoard(start.board.rows);
+		start.board.hash = game->g->getBoardHash();
+		start.lines = 0;
+		workers[0]->size = 0;
+		workers[0]->board = start.board;
+		expandBoard(workers[0], start, *root, 0);
+		memcpy(beam, workers[0]->best, workers[0]->size * sizeof(State));
+		beamSize = workers[0]->size;
+
+		for (int level = 1; level < depth && beamSize > 0; level++)
+		{
+			if (cancel != nullptr && *cancel)
+				return 0;
+			PiecePtr &p = game->queue[level];
+			game->g->getStart(p->type, p->getRotation(), spawn.x, spawn.y);
+			type = p->type;
+			expandLevel(level);
+			// a level where everything loses keeps the last beam, the best of it still tells the first move
+			if (nextSize == 0)
+				break;
+			memcpy(beam, next, nextSize * sizeof(State));
+			beamSize = nextSize;
+		}
+
+		for (int b = 0; b < beamSize; b++)
+			if (beam[b].score > bestScore)
+			{
+				bestScore = beam[b].score;
+				best = beam[b].first;
+			}
+		for (unsigned int i = 0; i < workers.size(); i++)
+		{
+			evaluations += workers[i]->evaluations;
+			duplicates += workers[i]->duplicates;
+			reused += workers[i]->reused;
+			workers[i]->evaluations = workers[i]->duplicates = workers[i]->reused = 0;
+		}
+		// every placement loses, any of them will do
+		if (best < 0)
+			best = 0;
+		chosen = root->placements[best].cells;
+		return root->sequence(best, out);
+	}
+
+private:
+	struct State
+	{
+		Bitboard board;
+		int lines, first;		// first: the placement of the falling piece it comes from
+		float score;
+	};
+
+	// a child board waiting for its value
+	struct Candidate
+	{
+		int placement, lines, lane;		// lane in the batch, -1 when the value came from the table
+		unsigned long long key;
+		float value;
+	};
+
+	// what one thread needs to expand beam boards, allocated once
+	struct Worker
+	{
+		MoveGenerator generator;
+		Bitboard board;				// the beam board being expanded, children are made and unmade on it
+		UndoStack undo;
+		Evaluator::Batch batch;
+		Candidate candidates[MoveGenerator::MAX_PLACEMENTS];
+		float values[MoveGenerator::MAX_PLACEMENTS];
+		State best[MAX_WIDTH];
+		int size;
+		long long evaluations, duplicates, reused;
+
+		Worker()
+		{
+			size = 0;
+			evaluations = duplicates = reused = 0;
+		}
+	};
+
+	// every thread takes beam boards until none is left, then the best of each thread are merged
+	void expandLevel(int l)
+	{
+		level = l;
+		nextBeam = 0;
+		for (unsigned int i = 0; i < workers.size(); i++)
+			workers[i]->size = 0;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			job++;
+			pending = (int)pool.size();
+		}
+		wake.notify_all();
+		expandBeam(workers[0]);
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			done.wait(lock, [this]() { return pending == 0; });
+		}
+		nextSize = 0;
+		for (unsigned int i = 0; i < workers.size(); i++)
+			for (int s = 0; s < workers[i]->size; s++)
+				keep(next, &nextSize, workers[i]->best[s]);
+	}
+
+	void expandBeam(Worker *w)
+	{
+		TRACE_ZONE("Bot::expandBeam");
+		int b;
+		while ((b = nextBeam++) < beamSize)
+		{
+			Cells cells = spawn;
+			if (!beam[b].board.spawn(&cells))
+				continue;
+			w->board = beam[b].board;
+			w->generator.generate(w->board, cells, type);
+			expandBoard(w, beam[b], w->generator, level);
+		}
+	}
+
+	void work(int i)
+	{
+		unsigned int seen = 0;
+		Trace::get().nameThread("bot");
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [&]() { return quit || job != seen; });
+				if (quit)
+					return;
+				seen = job;
+			}
+			expandBeam(workers[i]);
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (--pending == 0)
+					done.notify_one();
+			}
+		}
+	}
+
+	// makes every placement of generator on the worker board (the parent's board), takes the children already
+	// known from the table, evaluates the others in one batch and keeps the best
+	// a child board is only copied when it goes into the beam
+	void expandBoard(Worker *w, const State &parent, const MoveGenerator &generator, int l)
+	{
+		int count = 0, batched = 0;
+		for (int i = 0; i < generator.count; i++)
+		{
+			TranspositionTable::Result r;
+			Candidate &c = w->candidates[count];
+			Undo *u = w->undo.push();
+			w->board.make(generator.placements[i].cells, 0, u);
+			c.placement = i;
+			c.lines = parent.lines + u->lines;
+			c.key = w->board.hash ^ Zobrist::keys().queue[(base + l) % Zobrist::QUEUE];
+			c.lane = -1;
+			if (!w->board.lose())
+			{
+				if (!table->probe(c.key, &r))
+				{
+					c.lane = batched;
+					w->batch.set(batched++, w->board);
+					count++;
+				}
+				// the same pieces placed in another order, it is already in this search
+				else if (r.current)
+					w->duplicates++;
+				else
+				{
+					c.value = r.value;
+					w->reused++;
+					count++;
+				}
+			}
+			w->board.unmake(w->undo.pop());
+		}
+		if (network != nullptr)
+			network->evaluate(w->batch, batched, w->values);
+		else
+			evaluator.evaluate(w->batch, batched, w->values);
+		w->evaluations += batched;
+
+		for (int k = 0; k < count; k++)
+		{
+			Candidate &c = w->candidates[k];
+			float score;
+			if (c.lane >= 0)
+				c.value = w->values[c.lane];
+			table->store(c.key, c.value, depth - l - 1);
+			score = c.value + weights.lines * c.lines;
+			if (w->size == width && w->best[width - 1].score >= score)
+				continue;
+			State s;
+			Undo *u = w->undo.push();
+			w->board.make(generator.placements[c.placement].cells, 0, u);
+			s.board = w->board;
+			w->board.unmake(w->undo.pop());
+			s.lines = c.lines;
+			s.first = l == 0 ? c.placement : parent.first;
+			s.score = score;
+			keep(w->best, &w->size, s);
+		}
+	}
+
+	// the states are kept sorted, best first, and at most width of them
+	void keep(State *states, int *size, const State &s)
+	{
+		int at = *size < width ? *size : width - 1;
+		if (*size == width && states[at].score >= s.score)
+			return;
+		while (at > 0 && states[at - 1].score < s.score)
+		{
+			states[at] = states[at - 1];
+			at--;
+		}
+		states[at] = s;
+		if (*size < width)
+			(*size)++;
+	}
+
+	MoveGenerator *root;
+	TranspositionTable *table;
+	Evaluator evaluator;
+	Weights evaluated;				// the weights the values in the table were computed with
+	const Network *scored;			// and the network
+	State beam[MAX_WIDTH], next[MAX_WIDTH];
+	int beamSize, nextSize;
+
+	// the level being expanded, read by every thread
+	int level;
+	unsigned int base;
+	Cells spawn;
+	Piece::types type;
+	std::atomic<int> nextBeam;
+
+	std::vector<Worker*> workers;		// workers[0] is the calling thread
+	std::vector<std::thread> pool;
+	std::mutex mutex;
+	std::condition_variable wake, done;
+	unsigned int job;
+	int pending;
+	bool quit;
+};
+
+// Quadris.exe --bot [games] [width] [depth] [max pieces] [threads]
+// the bot plays headless games and prints how fast and how well it plays
+inline int benchmarkBot(int games, int width, int depth, int maxPieces, int threads, const Network *network = nullptr)
+{
+	Bot bot(width, depth, threads);
+	bot.network = network;
+	Replay::action inputs[MoveGenerator::MAX_INPUTS];
+	long long pieces = 0, lines = 0;
+	double thinking = 0.0;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int n = 0; n < games; n++)
+	{
+		Game game(nullptr, 0x51ED0000ULL + n);
+		int gamePieces = 0, gameLines = 0;
+		while (!game.g->lost && gamePieces < maxPieces)
+		{
+			std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
+			int count = bot.plan(&game, inputs);
+			thinking += std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count();
+			if (count == 0)
+				break;
+			for (int i = 0; i < count; i++)
+			{
+				game.execute(inputs[i], 1);
+				gameLines += game.linesCleared;
+			}
+			gamePieces++;
+		}
+		printf("game %d: %d pieces, %d lines, %.0f points%s\n", n, gamePieces, gameLines, game.g->getPoints(), game.g->lost ? "" : " (piece limit)");
+		pieces += gamePieces;
+		lines += gameLines;
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	printf("width %d depth %d: %lld pieces in %.3f s, %.1f pieces/s (%.1f thinking only), %.1f lines per game, %.3f lines per piece\n",
+		bot.width, bot.depth, pieces, seconds, seconds > 0.0 ? pieces / seconds : 0.0, thinking > 0.0 ? pieces / thinking : 0.0,
+		games > 0 ? (double)lines / games : 0.0, pieces > 0 ? (double)lines / pieces : 0.0);
+	printf("%d threads: %lld boards evaluated, %lld duplicates dropped, %lld taken from the previous search\n", bot.threads(), bot.evaluations, bot.duplicates, bot.reused);
+	return 0;
+}
+
+// Quadris.exe --net <weights> [games] [width] [depth]
+// boards per millisecond of the network next to Evaluator on the same boards, then the bot playing with the network
+// a file that does not load is replaced by a random int8 network over the cells, 64 and 32 hidden neurons
+inline int benchmarkNetwork(const char *path, int games, int width, int depth)
+{
+	static const int hidden[2] = { 64, 32 };
+	Network network;
+	Evaluator evaluator;
+	Evaluator::Batch *batch = new Evaluator::Batch();
+	float values[Evaluator::CAPACITY];
+	int count = 0;
+	if (!network.load(path))
+	{
+		printf("%s is not a network, a random one is used\n", path);
+		network.randomize(Network::inputs::CELLS, Network::precision::INT8, hidden, 2, 0x4E4E0000ULL);
+	}
+
+	// boards the bot would score: the children of the positions of a game
+	{
+		Game game(nullptr, 0x51ED0000ULL);
+		Bot bot;
+		MoveGenerator generator;
+		Replay::action inputs[MoveGenerator::MAX_INPUTS];
+		while (count < Evaluator::CAPACITY && !game.g->lost)
+		{
+			Bitboard board;
+			Undo u;
+			game.g->getBoard(board.rows);
+			board.hash = game.g->getBoardHash();
+			generator.generate(game.g);
+			for (int i = 0; i < generator.count && count < Evaluator::CAPACITY; i++)
+			{
+				board.make(generator.placements[i].cells, 0, &u);
+				batch->set(count++, board);
+				board.unmake(u);
+			}
+			int n = bot.plan(&game, inputs);
+			for (int i = 0; i < n; i++)
+				game.execute(inputs[i], 1);
+		}
+	}
+
+	for (int pass = 0; pass < 2; pass++)
+	{
+		long long boards = 0;
+		double seconds = 0.0;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		while (seconds < 0.5)
+		{
+			if (pass == 0)
+				network.evaluate(*batch, count, values);
+			else
+				evaluator.evaluate(*batch, count, values);
+			boards += count;
+			seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		}
+		printf("%s: %.0f boards/ms\n", pass == 1 ? "evaluator" : (network.getPrecision() == Network::precision::INT8 ? "network int8" : "network float"),
+			boards / (seconds * 1000.0));
+	}
+	delete batch;
+	return games > 0 ? benchmarkBot(games, width, depth, 2000, 1, &network) : 0;
+}
+
+#endif // !__bot_h
@@ -0,0 +1,527 @@
+#ifndef __dataset_h
+#define __dataset_h
+
+#include "bot.h"
+#include "game.h"
+#include "movegen.h"
+#include "snapshot.h"
+#include "trace.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// one decision of a game, fixed size so a shard is an array and record i is at a known offset
+// the board is the 20 visible lines without the falling piece, a bit per cell: bit l * 10 + c
+// the types go 3 bits each, the falling piece in the low bits, then the lines the placement cleared
+// the action is Cells::key() of where the piece was put, with LOST on when the game ended there
+struct Record
+{
+	static const int LINES = 20, COLUMNS = 10;
+	static const unsigned int LOST = 1u << 31;
+
+	unsigned char board[LINES * COLUMNS / 8];
+	unsigned char queue[3];
+	unsigned int action;
+
+	// the position the piece is about to be placed from, the outcome is filled by setResult
+	void set(Game *game, const Cells &cells)
+	{
+		unsigned short rows[Bitboard::LINES];
+		unsigned int bits = 0;
+		game->g->getBoard(rows);
+		memset(board, 0, sizeof(board));
+		for (int l = 0; l < LINES; l++)
+			for (int c = 0; c < COLUMNS; c++)
+				if (rows[l] & (1 << c))
+					board[(l * COLUMNS + c) >> 3] |= (unsigned char)(1 << ((l * COLUMNS + c) & 7));
+		for (int k = 0; k <= Game::PREVIEW; k++)
+			bits |= (unsigned int)game->queue[k]->type << (3 * k);
+		queue[0] = (unsigned char)bits;
+		queue[1] = (unsigned char)(bits >> 8);
+		queue[2] = (unsigned char)(bits >> 16);
+		action = cells.key();
+	}
+
+	void setResult(int lines, bool lost)
+	{
+		queue[2] = (unsigned char)((queue[2] & 0x1F) | (lines << 5));
+		action = lost ? action | LOST : action & ~LOST;
+	}
+
+	bool cell(int l, int c) const
+	{
+		return (board[(l * COLUMNS + c) >> 3] >> ((l * COLUMNS + c) & 7)) & 1;
+	}
+
+	// 0 is the falling piece, up to Game::PREVIEW
+	Piece::types type(int k) const
+	{
+		unsigned int bits = queue[0] | (queue[1] << 8) | (queue[2] << 16);
+		return (Piece::types)((bits >> (3 * k)) & 7);
+	}
+
+	int lines() const
+	{
+		return queue[2] >> 5;
+	}
+
+	bool lost() const
+	{
+		return (action & LOST) != 0;
+	}
+
+	// the cells back from the key
+	Cells cells() const
+	{
+		Cells out;
+		int n = 0;
+		for (int b = 0; b < 16 && n < 4; b++)
+			if (action & (1u << b))
+			{
+				out.x[n] = (int)((action >> 16) & 0x1F) + (b >> 2);
+				out.y[n] = (int)((action >> 21) & 0xF) + (b & 3);
+				n++;
+			}
+		return out;
+	}
+};
+
+static_assert(sizeof(Record) == 32, "records are written as they are");
+
+// every shard starts with this, the records follow
+struct ShardHeader
+{
+	static const unsigned int VERSION = 1;
+
+	char magic[4];
+	unsigned int version;
+	unsigned int recordSize;
+	unsigned int reserved;
+
+	ShardHeader()
+	{
+		memcpy(magic, "QDAT", 4);
+		version = VERSION;
+		recordSize = sizeof(Record);
+		reserved = 0;
+	}
+
+	bool valid() const
+	{
+		return memcmp(magic, "QDAT", 4) == 0 && version == VERSION && recordSize == sizeof(Record);
+	}
+};
+
+inline void shardPath(char out[280], const char *prefix, int shard)
+{
+	snprintf(out, 280, "%s-%05d.qds", prefix, shard);
+}
+
+// the shards of an older export with the same prefix, a reader would take them as part of the new one
+inline void removeShards(const char *prefix)
+{
+	for (int s = 0;; s++)
+	{
+		char path[280];
+		shardPath(path, prefix, s);
+		if (remove(path) != 0)
+			break;
+	}
+}
+
+// records go into blocks, a full block is handed to a thread that appends it to the shard on disk
+// the game only waits when every block is still waiting for the disk
+// a shard takes as many records as fit in the size given (1 MB at least), then prefix-00001.qds is started, and so on
+// the shards already there for the prefix are removed first
+class DatasetWriter
+{
+public:
+	static const int BLOCK = 1 << 15;		// records, 1 MB
+	static const int BLOCKS = 4;
+
+	DatasetWriter(const char *p, long long shardBytes = 256LL << 20)
+	{
+		strncpy(prefix, p, 255);
+		prefix[255] = '\0';
+		removeShards(prefix);
+		perShard = (shardBytes - (long long)sizeof(ShardHeader)) / (long long)sizeof(Record);
+		if (perShard < BLOCK)
+			perShard = BLOCK;
+		blocks.resize(BLOCKS);
+		for (int i = 0; i < BLOCKS; i++)
+			blocks[i].resize(BLOCK);
+		for (int i = 1; i < BLOCKS; i++)
+			spare.push_back(i);
+		current = 0;
+		used = 0;
+		file = NULL;
+		shard = 0;
+		inShard = 0;
+		written = 0;
+		failed = false;
+		quit = false;
+		worker = std::thread(&DatasetWriter::run, this);
+	}
+
+	~DatasetWriter()
+	{
+		close();
+	}
+
+	void add(const Record &r)
+	{
+		blocks[current][used++] = r;
+		if (used == BLOCK)
+			hand();
+	}
+
+	// writes what is left and waits for the disk, the writer takes nothing after it
+	void close()
+	{
+		if (!worker.joinable())
+			return;
+		if (used > 0)
+			hand();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quit = true;
+		}
+		wake.notify_one();
+		worker.join();
+		if (file != NULL)
+			fclose(file);
+		file = NULL;
+	}
+
+	// records on disk, once close has returned
+	long long records() const
+	{
+		return written;
+	}
+
+	int shards() const
+	{
+		return shard + (inShard > 0 ? 1 : 0);
+	}
+
+	bool ok() const
+	{
+		return !failed;
+	}
+
+private:
+	struct Full
+	{
+		int block, count;
+	};
+
+	void hand()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		full.push_back({ current, used });
+		wake.notify_one();
+		back.wait(lock, [this]() { return !spare.empty(); });
+		current = spare.back();
+		spare.pop_back();
+		used = 0;
+	}
+
+	void run()
+	{
+		Trace::get().nameThread("dataset writer");
+		while (true)
+		{
+			Full f;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [this]() { return quit || !full.empty(); });
+				if (full.empty())
+					return;
+				f = full.front();
+				full.erase(full.begin());
+			}
+			store(blocks[f.block].data(), f.count);
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				spare.push_back(f.block);
+			}
+			back.notify_one();
+		}
+	}
+
+	void store(const Record *r, int count)
+	{
+		TRACE_ZONE("DatasetWriter::store");
+		while (count > 0 && !failed)
+		{
+			if (file == NULL)
+			{
+				char path[280];
+				ShardHeader header;
+				shardPath(path, prefix, shard);
+				file = fopen(path, "wb");
+				if (file == NULL || fwrite(&header, sizeof(header), 1, file) != 1)
+				{
+					failed = true;
+					return;
+				}
+			}
+			int n = (int)(perShard - inShard < count ? perShard - inShard : count);
+			if (fwrite(r, sizeof(Record), n, file) != (size_t)n)
+				failed = true;
+			r += n;
+			count -= n;
+			inShard += n;
+			written += n;
+			if (inShard == perShard)
+			{
+				fclose(file);
+				file = NULL;
+				shard++;
+				inShard = 0;
+			}
+		}
+	}
+
+	char prefix[256];
+	long long perShard;
+	std::vector<std::vector<Record>> blocks;
+	int current, used;					// game thread only
+
+	// writer thread only, read once it is joined
+	FILE *file;
+	int shard;
+	long long inShard, written;
+	bool failed;
+
+	std::vector<int> spare;
+	std::vector<Full> full;
+	bool quit;
+	std::mutex mutex;
+	std::condition_variable wake, back;
+	std::thread worker;
+};
+
+// maps every shard of a prefix, record i is read in place without copying the file
+class DatasetReader
+{
+public:
+	DatasetReader()
+	{
+		total = 0;
+	}
+
+	~DatasetReader()
+	{
+		close();
+	}
+
+	// shards are taken in order until one is missing, false if there is none
+	bool open(const char *prefix)
+	{
+		close();
+		for (int s = 0;; s++)
+		{
+			char path[280];
+			Shard shard;
+			shardPath(path, prefix, s);
+			if (!map(path, &shard))
+				break;
+			shard.first = total;
+			total += shard.count;
+			shards.push_back(shard);
+		}
+		return !shards.empty();
+	}
+
+	void close()
+	{
+		for (unsigned int i = 0; i < shards.size(); i++)
+			unmap(shards[i]);
+		shards.clear();
+		total = 0;
+	}
+
+	long long size() const
+	{
+		return total;
+	}
+
+	const Record &operator[](long long i) const
+	{
+		// every shard but the last has the same count
+		long long s = i / shards[0].count;
+		if (s >= (long long)shards.size())
+			s = (long long)shards.size() - 1;
+		return shards[s].records[i - shards[s].first];
+	}
+
+private:
+	struct Shard
+	{
+		const Record *records;
+		long long first, count;
+		size_t bytes;
+		const void *view;
+#ifdef _WIN32
+		HANDLE file, mapping;
+#else
+		int file;
+#endif
+	};
+
+	static bool map(const char *path, Shard *s)
+	{
+		long long size = 0;
+		s->view = NULL;
+#ifdef _WIN32
+		LARGE_INTEGER length;
+		s->mapping = NULL;
+		s->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (s->file == INVALID_HANDLE_VALUE)
+			return false;
+		if (GetFileSizeEx(s->file, &length))
+			size = length.QuadPart;
+		if (size > (long long)sizeof(ShardHeader))
+		{
+			s->mapping = CreateFileMappingA(s->file, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (s->mapping != NULL)
+				s->view = MapViewOfFile(s->mapping, FILE_MAP_READ, 0, 0, 0);
+		}
+#else
+		struct stat info;
+		s->file = ::open(path, O_RDONLY);
+		if (s->file < 0)
+			return false;
+		if (fstat(s->file, &info) == 0)
+			size = (long long)info.st_size;
+		if (size > (long long)sizeof(ShardHeader))
+		{
+			s->view = mmap(NULL, (size_t)size, PROT_READ, MAP_SHARED, s->file, 0);
+			if (s->view == MAP_FAILED)
+				s->view = NULL;
+		}
+#endif
+		s->bytes = (size_t)size;
+		if (s->view == NULL || !((const ShardHeader *)s->view)->valid() || size < (long long)(sizeof(ShardHeader) + sizeof(Record)))
+		{
+			unmap(*s);
+			return false;
+		}
+		s->records = (const Record *)((const char *)s->view + sizeof(ShardHeader));
+		s->count = (size - (long long)sizeof(ShardHeader)) / (long long)sizeof(Record);
+		return true;
+	}
+
+	static void unmap(Shard &s)
+	{
+#ifdef _WIN32
+		if (s.view != NULL)
+			UnmapViewOfFile(s.view);
+		if (s.mapping != NULL)
+			CloseHandle(s.mapping);
+		CloseHandle(s.file);
+#else
+		if (s.view != NULL)
+			munmap((void *)s.view, s.bytes);
+		::close(s.file);
+#endif
+	}
+
+	std::vector<Shard> shards;
+	long long total;
+};
+
+// Quadris.exe --export <prefix> [games] [width] [depth] [shard MB] [max pieces]
+// the bot plays the same games twice, without and with the export, then every record is read back in a random order
+// a game stops at max pieces, a strong bot would otherwise never lose
+inline int exportSelfPlay(const char *prefix, int games, int width, int depth, int shardMegabytes, int maxPieces)
+{
+	Replay::action inputs[MoveGenerator::MAX_INPUTS];
+	double seconds[2] = { 0.0, 0.0 };
+	long long pieces = 0;
+	long long records = 0;
+
+	for (int pass = 0; pass < 2; pass++)
+	{
+		Bot bot(width, depth);
+		DatasetWriter *writer = pass == 1 ? new DatasetWriter(prefix, (long long)shardMegabytes << 20) : nullptr;
+		Record r;
+		pieces = 0;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int n = 0; n < games; n++)
+		{
+			Game game(nullptr, 0xDA7A0000ULL + n);
+			for (int p = 0; !game.g->lost && p < maxPieces; p++)
+			{
+				int count = bot.plan(&game, inputs), lines = 0;
+				if (count == 0)
+					break;
+				if (writer != nullptr)
+					r.set(&game, bot.chosen);
+				for (int i = 0; i < count; i++)
+				{
+					game.execute(inputs[i], 1);
+					lines += game.linesCleared;
+				}
+				if (writer != nullptr)
+				{
+					r.setResult(lines, game.g->lost);
+					writer->add(r);
+				}
+				pieces++;
+			}
+		}
+		if (writer != nullptr)
+		{
+			writer->close();
+			records = writer->records();
+			if (!writer->ok())
+				printf("could not write %s\n", prefix);
+			printf("%lld records in %d shards\n", records, writer->shards());
+			delete writer;
+		}
+		seconds[pass] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+	printf("%lld pieces: %.3f s without the export, %.3f s with it (%+.1f%%)\n", pieces, seconds[0], seconds[1],
+		seconds[0] > 0.0 ? 100.0 * (seconds[1] - seconds[0]) / seconds[0] : 0.0);
+
+	DatasetReader reader;
+	if (!reader.open(prefix))
+	{
+		printf("no shard to read at %s\n", prefix);
+		return 1;
+	}
+	long long lines = 0, lost = 0, bad = 0, visited = 0;
+	// an LCG mod a power of two with a = 1 mod 4 and c odd goes through every number below it once,
+	// the ones past the last record are skipped: every record is read once, in an order spread over the shards
+	unsigned long long period = 1, x = 0;
+	while (period < (unsigned long long)reader.size())
+		period <<= 1;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (unsigned long long i = 0; i < period; i++)
+	{
+		x = (x * 6364136223846793005ULL + 1442695040888963407ULL) & (period - 1);
+		if (x >= (unsigned long long)reader.size())
+			continue;
+		visited++;
+		const Record &rec = reader[(long long)x];
+		Cells c = rec.cells();
+		lines += rec.lines();
+		lost += rec.lost() ? 1 : 0;
+		for (int k = 0; k < 4; k++)
+			if (c.x[k] < Record::LINES && rec.cell(c.x[k], c.y[k]))
+				bad++;
+	}
+	double read = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	printf("read back %lld of %lld records in a random order in %.3f s: %lld lines, %lld games lost, %lld placements on filled cells\n",
+		visited, records, read, lines, lost, bad);
+	return reader.size() == records && visited == records && bad == 0 ? 0 : 1;
+}
+
+#endif // !__dataset_h
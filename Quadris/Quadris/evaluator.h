@@ -0,0 +1,243 @@
+#ifndef __evaluator_h
+#define __evaluator_h
+
+#include "movegen.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define EVALUATOR_SSE2
+#endif
+
+// scores boards by a weighted sum of features
+// every feature is a popcount of a row worked out from the row and the rows above it:
+//   covered  = the row or any row above it, so a column is covered up to its height
+//   height   = sum of popcount(covered), the aggregate height
+//   holes    = popcount(covered above & ~row)
+//   bumpiness= popcount(covered ^ covered >> 1), neighbour columns of different heights
+//   wells    = popcount(~covered & both neighbours covered), walls count as covered
+//   row and column transitions, filled next to empty along the row (walls filled) and along the column (floor filled)
+// a column of boards is one SIMD lane each, so a batch does 16 boards per row with AVX2 and 8 with SSE2
+class Evaluator
+{
+public:
+	static const int ROWS = 24;					// lines 24 and above never hold a placed piece
+	static const int CAPACITY = MoveGenerator::MAX_PLACEMENTS;
+
+	struct Weights
+	{
+		float height;				// sum of the column heights
+		float lines;				// lines cleared on the way, added by the caller
+		float holes;				// empty cells with something above them
+		float bumpiness;			// sum of the height differences between neighbour columns
+		float wells;				// sum of how deep every column is below both neighbours
+		float rowTransitions;		// filled/empty changes along the rows
+		float columnTransitions;	// filled/empty changes along the columns
+
+		Weights()
+		{
+			height = -0.51f;
+			lines = 0.76f;
+			holes = -0.36f;
+			bumpiness = -0.18f;
+			wells = -0.1f;
+			rowTransitions = 0.0f;
+			columnTransitions = 0.0f;
+		}
+	};
+
+	struct Features
+	{
+		int height, holes, bumpiness, wells, rowTransitions, columnTransitions;
+	};
+
+	// boards stored column by column, rows[l][i] is line l of board i
+	// not over-aligned: Batch and the Bot workers holding it are made with new, which is 16 bytes before C++17,
+	// every read of rows is an unaligned load
+	struct Batch
+	{
+		unsigned short rows[ROWS][CAPACITY];
+
+		void set(int i, const Bitboard &b)
+		{
+			for (int l = 0; l < ROWS; l++)
+				rows[l][i] = b.rows[l];
+		}
+	};
+
+	Weights weights;
+
+	static void features(const Bitboard &b, Features *f)
+	{
+		unsigned int covered = 0, above = 0;
+		f->height = f->holes = f->bumpiness = f->wells = f->rowTransitions = f->columnTransitions = 0;
+		for (int l = ROWS - 1; l >= 0; l--)
+		{
+			unsigned int row = b.rows[l], edges = (row << 1) | 0x801;
+			f->holes += popcount(covered & ~row);
+			covered |= row;
+			f->height += popcount(covered);
+			f->bumpiness += popcount((covered ^ (covered >> 1)) & 0x1FF);
+			f->wells += popcount(~covered & ((covered << 1) | 1) & ((covered >> 1) | 0x200) & 0x3FF);
+			if (l <= 20)
+				f->rowTransitions += popcount((edges ^ (edges >> 1)) & 0x7FF);
+			f->columnTransitions += popcount(row ^ above);
+			above = row;
+		}
+		f->columnTransitions += popcount(above ^ 0x3FF);
+	}
+
+	// everything but the lines, they depend on the way there and not only on the board
+	float evaluate(const Bitboard &b) const
+	{
+		Features f;
+		features(b, &f);
+		return score(f);
+	}
+
+	float score(const Features &f) const
+	{
+		return weights.height * f.height + weights.holes * f.holes + weights.bumpiness * f.bumpiness + weights.wells * f.wells
+			+ weights.rowTransitions * f.rowTransitions + weights.columnTransitions * f.columnTransitions;
+	}
+
+	// the first count boards of batch, same values as evaluate one by one
+	void evaluate(const Batch &batch, int count, float *out) const
+	{
+		int i = 0;
+#if defined(__AVX2__)
+		for (; i + 16 <= count; i += 16)
+			evaluate16(batch, i, out + i);
+#elif defined(EVALUATOR_SSE2)
+		for (; i + 8 <= count; i += 8)
+			evaluate8(batch, i, out + i);
+#endif
+		for (; i < count; i++)
+		{
+			Bitboard b;
+			for (int l = 0; l < ROWS; l++)
+				b.rows[l] = batch.rows[l][i];
+			out[i] = evaluate(b);
+		}
+	}
+
+private:
+	static int popcount(unsigned int v)
+	{
+		v = v - ((v >> 1) & 0x55555555);
+		v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
+		return (int)((((v + (v >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24);
+	}
+
+	void scoreLanes(const unsigned short *sums, int lanes, float *out) const
+	{
+		// sums: height, holes, bumpiness, wells, row and column transitions, lanes values each
+		for (int k = 0; k < lanes; k++)
+		{
+			Features f;
+			f.height = sums[k];
+			f.holes = sums[lanes + k];
+			f.bumpiness = sums[2 * lanes + k];
+			f.wells = sums[3 * lanes + k];
+			f.rowTransitions = sums[4 * lanes + k];
+			f.columnTransitions = sums[5 * lanes + k];
+			out[k] = score(f);
+		}
+	}
+
+#if defined(__AVX2__)
+	// popcount of every 16 bit lane
+	static __m256i popcount16(__m256i x)
+	{
+		x = _mm256_sub_epi16(x, _mm256_and_si256(_mm256_srli_epi16(x, 1), _mm256_set1_epi16(0x5555)));
+		x = _mm256_add_epi16(_mm256_and_si256(x, _mm256_set1_epi16(0x3333)), _mm256_and_si256(_mm256_srli_epi16(x, 2), _mm256_set1_epi16(0x3333)));
+		x = _mm256_and_si256(_mm256_add_epi16(x, _mm256_srli_epi16(x, 4)), _mm256_set1_epi16(0x0F0F));
+		return _mm256_and_si256(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), _mm256_set1_epi16(0x1F));
+	}
+
+	void evaluate16(const Batch &batch, int first, float *out) const
+	{
+		const __m256i full = _mm256_set1_epi16(0x3FF), wall = _mm256_set1_epi16(0x801), one = _mm256_set1_epi16(1);
+		const __m256i left = _mm256_set1_epi16(0x1FF), right = _mm256_set1_epi16(0x200), rowMask = _mm256_set1_epi16(0x7FF);
+		__m256i covered = _mm256_setzero_si256(), above = _mm256_setzero_si256();
+		__m256i height = covered, holes = covered, bumpiness = covered, wells = covered, rowT = covered, columnT = covered;
+		for (int l = ROWS - 1; l >= 0; l--)
+		{
+			__m256i row = _mm256_loadu_si256((const __m256i *)&batch.rows[l][first]);
+			__m256i edges = _mm256_or_si256(_mm256_slli_epi16(row, 1), wall);
+			holes = _mm256_add_epi16(holes, popcount16(_mm256_andnot_si256(row, covered)));
+			covered = _mm256_or_si256(covered, row);
+			height = _mm256_add_epi16(height, popcount16(covered));
+			bumpiness = _mm256_add_epi16(bumpiness, popcount16(_mm256_and_si256(_mm256_xor_si256(covered, _mm256_srli_epi16(covered, 1)), left)));
+			wells = _mm256_add_epi16(wells, popcount16(_mm256_andnot_si256(covered, _mm256_and_si256(full,
+				_mm256_and_si256(_mm256_or_si256(_mm256_slli_epi16(covered, 1), one), _mm256_or_si256(_mm256_srli_epi16(covered, 1), right))))));
+			if (l <= 20)
+				rowT = _mm256_add_epi16(rowT, popcount16(_mm256_and_si256(_mm256_xor_si256(edges, _mm256_srli_epi16(edges, 1)), rowMask)));
+			columnT = _mm256_add_epi16(columnT, popcount16(_mm256_xor_si256(row, above)));
+			above = row;
+		}
+		columnT = _mm256_add_epi16(columnT, popcount16(_mm256_xor_si256(above, full)));
+		// the weighted sum in floats too, 8 lanes at a time
+		for (int half = 0; half < 2; half++)
+		{
+			__m256 sum = _mm256_mul_ps(widen(height, half), _mm256_set1_ps(weights.height));
+			sum = _mm256_add_ps(sum, _mm256_mul_ps(widen(holes, half), _mm256_set1_ps(weights.holes)));
+			sum = _mm256_add_ps(sum, _mm256_mul_ps(widen(bumpiness, half), _mm256_set1_ps(weights.bumpiness)));
+			sum = _mm256_add_ps(sum, _mm256_mul_ps(widen(wells, half), _mm256_set1_ps(weights.wells)));
+			sum = _mm256_add_ps(sum, _mm256_mul_ps(widen(rowT, half), _mm256_set1_ps(weights.rowTransitions)));
+			sum = _mm256_add_ps(sum, _mm256_mul_ps(widen(columnT, half), _mm256_set1_ps(weights.columnTransitions)));
+			_mm256_storeu_ps(out + 8 * half, sum);
+		}
+	}
+
+	// 8 of the 16 bit lanes as floats
+	static __m256 widen(__m256i x, int half)
+	{
+		__m128i part = half == 0 ? _mm256_castsi256_si128(x) : _mm256_extracti128_si256(x, 1);
+		return _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(part));
+	}
+#elif defined(EVALUATOR_SSE2)
+	static __m128i popcount16(__m128i x)
+	{
+		x = _mm_sub_epi16(x, _mm_and_si128(_mm_srli_epi16(x, 1), _mm_set1_epi16(0x5555)));
+		x = _mm_add_epi16(_mm_and_si128(x, _mm_set1_epi16(0x3333)), _mm_and_si128(_mm_srli_epi16(x, 2), _mm_set1_epi16(0x3333)));
+		x = _mm_and_si128(_mm_add_epi16(x, _mm_srli_epi16(x, 4)), _mm_set1_epi16(0x0F0F));
+		return _mm_and_si128(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), _mm_set1_epi16(0x1F));
+	}
+
+	void evaluate8(const Batch &batch, int first, float *out) const
+	{
+		const __m128i full = _mm_set1_epi16(0x3FF), wall = _mm_set1_epi16(0x801), one = _mm_set1_epi16(1);
+		const __m128i left = _mm_set1_epi16(0x1FF), right = _mm_set1_epi16(0x200), rowMask = _mm_set1_epi16(0x7FF);
+		__m128i covered = _mm_setzero_si128(), above = _mm_setzero_si128();
+		__m128i height = covered, holes = covered, bumpiness = covered, wells = covered, rowT = covered, columnT = covered;
+		alignas(16) unsigned short sums[6 * 8];
+		for (int l = ROWS - 1; l >= 0; l--)
+		{
+			__m128i row = _mm_loadu_si128((const __m128i *)&batch.rows[l][first]);
+			__m128i edges = _mm_or_si128(_mm_slli_epi16(row, 1), wall);
+			holes = _mm_add_epi16(holes, popcount16(_mm_andnot_si128(row, covered)));
+			covered = _mm_or_si128(covered, row);
+			height = _mm_add_epi16(height, popcount16(covered));
+			bumpiness = _mm_add_epi16(bumpiness, popcount16(_mm_and_si128(_mm_xor_si128(covered, _mm_srli_epi16(covered, 1)), left)));
+			wells = _mm_add_epi16(wells, popcount16(_mm_andnot_si128(covered, _mm_and_si128(full,
+				_mm_and_si128(_mm_or_si128(_mm_slli_epi16(covered, 1), one), _mm_or_si128(_mm_srli_epi16(covered, 1), right))))));
+			if (l <= 20)
+				rowT = _mm_add_epi16(rowT, popcount16(_mm_and_si128(_mm_xor_si128(edges, _mm_srli_epi16(edges, 1)), rowMask)));
+			columnT = _mm_add_epi16(columnT, popcount16(_mm_xor_si128(row, above)));
+			above = row;
+		}
+		columnT = _mm_add_epi16(columnT, popcount16(_mm_xor_si128(above, full)));
+		_mm_store_si128((__m128i *)&sums[0], height);
+		_mm_store_si128((__m128i *)&sums[8], holes);
+		_mm_store_si128((__m128i *)&sums[16], bumpiness);
+		_mm_store_si128((__m128i *)&sums[24], wells);
+		_mm_store_si128((__m128i *)&sums[32], rowT);
+		_mm_store_si128((__m128i *)&sums[40], columnT);
+		scoreLanes(sums, 8, out);
+	}
+#endif
+};
+
+#endif // !__evaluator_h
@@ -0,0 +1,294 @@
+#ifndef __framebench_h
+#define __framebench_h
+
+#include "allocations.h"
+#include "random.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+// GL calls and draw calls of the frame, counted by wrappers put in place of glad's pointers
+// only the entry points the game and the ImGui backend use every frame are wrapped
+struct GLCounters
+{
+	long long calls, draws;
+};
+
+inline GLCounters &glCounters()
+{
+	static GLCounters counters = { 0, 0 };
+	return counters;
+}
+
+template <int N, bool DRAW, typename F>
+struct GLHook;
+
+template <int N, bool DRAW, typename R, typename... A>
+struct GLHook<N, DRAW, R (APIENTRYP)(A...)>
+{
+	static R (APIENTRYP real)(A...);
+
+	static R APIENTRY call(A... a)
+	{
+		GLCounters &c = glCounters();
+		c.calls++;
+		if (DRAW)
+			c.draws++;
+		return real(a...);
+	}
+
+	static void install(R (APIENTRYP &slot)(A...))
+	{
+		if (slot == nullptr || slot == call)
+			return;
+		real = slot;
+		slot = call;
+	}
+};
+
+template <int N, bool DRAW, typename R, typename... A>
+R (APIENTRYP GLHook<N, DRAW, R (APIENTRYP)(A...)>::real)(A...) = nullptr;
+
+#define GL_HOOK(name, draw) GLHook<__LINE__, draw, decltype(glad_##name)>::install(glad_##name)
+
+// after gladLoadGLLoader, every call made through glad from then on is counted
+inline void installGLCounters()
+{
+	GL_HOOK(glDrawArrays, true);
+	GL_HOOK(glDrawElements, true);
+	GL_HOOK(glActiveTexture, false);
+	GL_HOOK(glBindBuffer, false);
+	GL_HOOK(glBindSampler, false);
+	GL_HOOK(glBindTexture, false);
+	GL_HOOK(glBindVertexArray, false);
+	GL_HOOK(glBlendEquation, false);
+	GL_HOOK(glBlendEquationSeparate, false);
+	GL_HOOK(glBlendFunc, false);
+	GL_HOOK(glBlendFuncSeparate, false);
+	GL_HOOK(glBufferData, false);
+	GL_HOOK(glClear, false);
+	GL_HOOK(glClearColor, false);
+	GL_HOOK(glDeleteVertexArrays, false);
+	GL_HOOK(glDisable, false);
+	GL_HOOK(glEnable, false);
+	GL_HOOK(glEnableVertexAttribArray, false);
+	GL_HOOK(glGenVertexArrays, false);
+	GL_HOOK(glGetError, false);
+	GL_HOOK(glGetIntegerv, false);
+	GL_HOOK(glGetUniformLocation, false);
+	GL_HOOK(glIsEnabled, false);
+	GL_HOOK(glLineWidth, false);
+	GL_HOOK(glPolygonMode, false);
+	GL_HOOK(glScissor, false);
+	GL_HOOK(glTexImage2D, false);
+	GL_HOOK(glTexParameteri, false);
+	GL_HOOK(glUniform1f, false);
+	GL_HOOK(glUniform1i, false);
+	GL_HOOK(glUniform2f, false);
+	GL_HOOK(glUniform2fv, false);
+	GL_HOOK(glUniform3f, false);
+	GL_HOOK(glUniform3fv, false);
+	GL_HOOK(glUniform4f, false);
+	GL_HOOK(glUniform4fv, false);
+	GL_HOOK(glUniformMatrix2fv, false);
+	GL_HOOK(glUniformMatrix3fv, false);
+	GL_HOOK(glUniformMatrix4fv, false);
+	GL_HOOK(glUseProgram, false);
+	GL_HOOK(glVertexAttribPointer, false);
+	GL_HOOK(glViewport, false);
+}
+
+#undef GL_HOOK
+
+// keys as processInput would read them, made up frame by frame from a seed
+// a tap of A, D, O or P every few frames, S held for a while now and then, I once in a long while
+class InputScript
+{
+public:
+	InputScript(unsigned long long seed) : random(seed)
+	{
+		frame = 0;
+		tapped = 0;
+		memset(down, 0, sizeof(down));
+	}
+
+	void advance()
+	{
+		static const int taps[6] = { GLFW_KEY_A, GLFW_KEY_D, GLFW_KEY_O, GLFW_KEY_P, GLFW_KEY_A, GLFW_KEY_D };
+		memset(down, 0, sizeof(down));
+		if (frame % 8 == 0)
+			tapped = taps[random() % 6];
+		if (frame % 8 < 2)
+			set(tapped);
+		if (frame % 300 >= 150 && frame % 300 < 200)
+			set(GLFW_KEY_S);
+		if (frame % 240 == 239)
+			set(GLFW_KEY_I);
+		frame++;
+	}
+
+	int state(int key) const
+	{
+		return key >= 0 && key < KEYS && down[key] ? GLFW_PRESS : GLFW_RELEASE;
+	}
+
+private:
+	static const int KEYS = 128;
+
+	void set(int key)
+	{
+		down[key] = true;
+	}
+
+	Random random;
+	long long frame;
+	int tapped;
+	bool down[KEYS];
+};
+
+// Quadris.exe --bench-frames [frames per scene] [output.json] [native | egl | osmesa]
+// the real render loop in a hidden window, without vsync, through the menu, the TOPPERS popup and a game fed by InputScript
+// every frame records its time, the time until it was handed to glfwSwapBuffers, GL calls, draw calls and allocations
+class FrameBenchmark
+{
+public:
+	enum class scene { MENU, TOPPERS, GAMEPLAY, DONE };
+
+	static const int WARMUP = 30;			// frames of each scene left out: shaders, font atlas, first uploads
+
+	FrameBenchmark(int frames, const char *path) : input(0xF4A3E000ULL)
+	{
+		perScene = frames < 1 ? 1 : frames;
+		output = path;
+		frame = 0;
+		current = scene::MENU;
+		samples.resize((size_t)SCENES * perScene);
+	}
+
+	// the seed of the games the benchmark plays
+	unsigned long long seed() const
+	{
+		return 0xF4A3E000ULL;
+	}
+
+	// at the top of the loop, the scene the frame has to show
+	scene beginFrame()
+	{
+		current = frame / (WARMUP + perScene) < SCENES ? (scene)(frame / (WARMUP + perScene)) : scene::DONE;
+		if (current == scene::GAMEPLAY)
+			input.advance();
+		start = std::chrono::steady_clock::now();
+		counters = glCounters();
+		allocated = allocations().count;
+		return current;
+	}
+
+	// the first frame of its scene
+	bool first() const
+	{
+		return frame % (WARMUP + perScene) == 0;
+	}
+
+	int key(int k) const
+	{
+		return input.state(k);
+	}
+
+	// right before glfwSwapBuffers
+	void submitted()
+	{
+		submit = std::chrono::steady_clock::now();
+	}
+
+	// right after glfwSwapBuffers
+	void endFrame()
+	{
+		int inScene = frame % (WARMUP + perScene) - WARMUP;
+		if (inScene >= 0 && current != scene::DONE)
+		{
+			Sample &s = samples[(size_t)current * perScene + inScene];
+			std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+			s.frame = std::chrono::duration<double, std::milli>(end - start).count();
+			s.submit = std::chrono::duration<double, std::milli>(submit - start).count();
+			s.calls = glCounters().calls - counters.calls;
+			s.draws = glCounters().draws - counters.draws;
+			s.allocations = allocations().count - allocated;
+		}
+		frame++;
+	}
+
+	// JSON with the distribution of each scene, on stdout when no file was given
+	int report()
+	{
+		static const char *names[SCENES] = { "menu", "toppers", "gameplay" };
+		FILE *out = output != nullptr ? fopen(output, "w") : stdout;
+		if (out == NULL)
+		{
+			printf("could not write %s\n", output);
+			return 1;
+		}
+		fprintf(out, "{\n  \"benchmark\": \"frames\",\n  \"frames_per_scene\": %d,\n  \"scenes\": [\n", perScene);
+		for (int s = 0; s < SCENES; s++)
+		{
+			Sample *rows = &samples[(size_t)s * perScene];
+			std::vector<double> times(perScene), submits(perScene);
+			double calls = 0.0, draws = 0.0, allocs = 0.0;
+			long long maxAllocs = 0;
+			for (int i = 0; i < perScene; i++)
+			{
+				times[i] = rows[i].frame;
+				submits[i] = rows[i].submit;
+				calls += rows[i].calls;
+				draws += rows[i].draws;
+				allocs += (double)rows[i].allocations;
+				maxAllocs = std::max(maxAllocs, rows[i].allocations);
+			}
+			fprintf(out, "    {\"scene\": \"%s\", ", names[s]);
+			distribution(out, "frame_ms", times);
+			fprintf(out, ", ");
+			distribution(out, "submit_ms", submits);
+			fprintf(out, ", \"gl_calls_per_frame\": %.1f, \"draw_calls_per_frame\": %.1f, \"allocs_per_frame\": %.2f, \"max_allocs_per_frame\": %lld}%s\n",
+				calls / perScene, draws / perScene, allocs / perScene, maxAllocs, s + 1 < SCENES ? "," : "");
+		}
+		fprintf(out, "  ]\n}\n");
+		if (out != stdout)
+			fclose(out);
+		return 0;
+	}
+
+private:
+	static const int SCENES = (int)scene::DONE;
+
+	struct Sample
+	{
+		double frame, submit;
+		long long calls, draws, allocations;
+	};
+
+	static void distribution(FILE *out, const char *name, std::vector<double> &v)
+	{
+		double sum = 0.0;
+		for (unsigned int i = 0; i < v.size(); i++)
+			sum += v[i];
+		std::sort(v.begin(), v.end());
+		fprintf(out, "\"%s\": {\"mean\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f}", name, sum / v.size(),
+			v[v.size() / 2], v[v.size() * 9 / 10], v[v.size() * 99 / 100], v.back());
+	}
+
+	int perScene;
+	const char *output;
+	long long frame;
+	scene current;
+	InputScript input;
+	std::vector<Sample> samples;
+
+	// the frame running
+	std::chrono::steady_clock::time_point start, submit;
+	GLCounters counters;
+	long long allocated;
+};
+
+#endif // !__framebench_h
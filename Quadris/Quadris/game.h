@@ -0,0 +1,313 @@
+#ifndef __game_h
+#define __game_h
+
+#include "pieces.h"
+#include "grid.h"
+#include "random.h"
+#include "replay.h"
+#include "snapshot.h"
+#include "trace.h"
+
+#include <ctime>
+#include <vector>
+
+// one game: the grid, the falling piece, the preview queue and the bag they come from
+// with a null shader nothing touches OpenGL, so bots and tools can run it headless
+class Game
+{
+public:
+	static const int PREVIEW = 6;
+
+	Grid *g;
+	std::vector<PiecePtr> queue;		// queue[0] is the falling piece, 1..PREVIEW the next pieces
+	std::vector<int> bag;
+	Random random_type, random_rotation;
+	unsigned long long seed;
+	Replay replay;
+	double clock;					// seconds of actual play, replay ticks are taken from it
+	int linesCleared;
+	unsigned int pieces;			// pieces locked since the game (or its snapshot) started
+	bool archivable;				// the replay starts where the game did, restore clears it until the replay is loaded
+	bool assisted;					// the bot played some of it: no score under the player's name, no replay
+
+	Game(Shader *s, unsigned long long sd, int level = 0)
+	{
+		shader = s;
+		seed = sd;
+		clock = 0.0;
+		linesCleared = 0;
+		pieces = 0;
+		archivable = true;
+		assisted = false;
+		replay.begin(seed, level, (unsigned long long)std::time(nullptr));
+		random_type.seed(seed);
+		random_rotation.seed(seed ^ 0x5DEECE66DULL);
+		g = shader != nullptr ? new Grid(*shader) : new Grid();
+		if (level > 0)
+			g->setLevel(level);
+
+		for (int i = 0; i < 7; i++)
+			bag.push_back(i);
+		queue.reserve(PREVIEW + 1);
+		for (int i = 0; i <= PREVIEW; i++)
+			queue.push_back(newPiece());
+		setModels();
+		g->start(&queue[0]);
+	}
+
+	~Game()
+	{
+		delete g;
+	}
+
+	// the same as a new Game(shader, sd, level) but the grid, the pieces and the buffers are kept, nothing is allocated
+	void reset(unsigned long long sd, int level = 0)
+	{
+		seed = sd;
+		clock = 0.0;
+		linesCleared = 0;
+		pieces = 0;
+		archivable = true;
+		assisted = false;
+		replay.begin(seed, level, (unsigned long long)std::time(nullptr));
+		random_type.seed(seed);
+		random_rotation.seed(seed ^ 0x5DEECE66DULL);
+		g->reset();
+		if (level > 0)
+			g->setLevel(level);
+
+		bag.clear();
+		for (int i = 0; i < 7; i++)
+			bag.push_back(i);
+		for (int i = 0; i <= PREVIEW; i++)
+			queue[i] = next(queue[i]);
+		setModels();
+		g->start(&queue[0]);
+	}
+
+	static unsigned long long newSeed()
+	{
+		std::random_device rd;
+		return ((unsigned long long)rd() << 32) | rd();
+	}
+
+	PiecePtr newPiece()
+	{
+		return newPiece((Piece::types)pop_bag(random_type() % 7), (Piece::rotation)(random_rotation() % 4));
+	}
+
+	// the next piece of the bag, the piece that just locked is turned into it when nothing else holds it,
+	// so a long game allocates nothing (the texture is shared and setModels places the preview again)
+	PiecePtr next(PiecePtr &used)
+	{
+		if (!used.unique())
+			return newPiece();
+		used->reset((Piece::types)pop_bag(random_type() % 7), (Piece::rotation)(random_rotation() % 4));
+		return used;
+	}
+
+	PiecePtr newPiece(Piece::types t, Piece::rotation r)
+	{
+		if (shader != nullptr)
+			return PiecePtr(new Piece(*shader, t, r));
+		return PiecePtr(new Piece(t, r));
+	}
+
+	int pop_bag(int nth)
+	{
+		int chosen, index = nth % bag.size(), temp;
+		chosen = temp = bag.at(index);
+		bag.at(index) = bag.back();
+		bag.at(bag.size() - 1) = temp;
+		bag.pop_back();
+		if (bag.empty())
+			for (int i = 0; i < 7; i++)
+				bag.push_back(i);
+		return chosen;
+	}
+
+	unsigned int ticks()
+	{
+		return (unsigned int)(clock * 1000.0);
+	}
+
+	// every move that changes the board goes through here so it ends up in the replay
+	void apply(Replay::action a)
+	{
+		TRACE_ZONE("Game::apply");
+		replay.record(a, ticks());
+		execute(a, 1);
+		if ((a == Replay::action::LOCK || a == Replay::action::HARD_DROP) && replay.needsKeyframe(ticks()))
+		{
+			Snapshot s;
+			snapshot(&s);
+			replay.addKeyframe(s);
+		}
+	}
+
+	// linesCleared is left with the lines the last lock cleared
+	void execute(Replay::action a, unsigned int count)
+	{
+		linesCleared = 0;
+		switch (a)
+		{
+		case Replay::action::LEFT:
+			g->translate(false);
+			break;
+		case Replay::action::RIGHT:
+			g->translate(true);
+			break;
+		case Replay::action::ROTATE_CW:
+			g->rotate(true);
+			break;
+		case Replay::action::ROTATE_CCW:
+			g->rotate(false);
+			break;
+		case Replay::action::FALL:
+			for (unsigned int i = 0; i < count; i++)
+				g->fall();
+			break;
+		case Replay::action::LOCK:
+		case Replay::action::HARD_DROP:
+			linesCleared = lockPiece();
+			break;
+		case Replay::action::EXTENDED:
+			if (count >= Replay::LEVEL && count < Replay::LEVEL + 6)
+				g->setLevel(count - Replay::LEVEL);
+			break;
+		default:
+			break;
+		}
+	}
+
+	void setLevel(int level)
+	{
+		replay.recordExtended((unsigned char)(Replay::LEVEL + level), ticks());
+		g->setLevel(level);
+	}
+
+	void softDrop(bool on)
+	{
+		replay.recordExtended(on ? Replay::SOFT_DROP_ON : Replay::SOFT_DROP_OFF, ticks());
+	}
+
+	void setName(char *n)
+	{
+		g->setName(n);
+		replay.setName(n);
+	}
+
+	// only a game the player played alone goes to the leaderboard
+	void saveScore(Leaderboard *board)
+	{
+		if (!assisted)
+			g->saveScore(board);
+	}
+
+	// keeps the replay of every game that was actually played
+	void archive(const char *dir)
+	{
+		char path[300];
+		replay.flush();
+		if (replay.data.empty() || !archivable || assisted)
+			return;
+		replay.points = (int)g->getPoints();
+		makeDirectory(dir);
+		snprintf(path, 300, "%s/%llu_%016llx.qrp", dir, replay.timestamp, seed);
+		replay.save(path);
+	}
+
+	// drop what is left, clear lines and bring the next piece in
+	// returns how many lines were cleared
+	int lockPiece()
+	{
+		int lines;
+		g->change = false;
+		g->fallAllTheWay();
+		g->change = false;
+		g->endgame = false;
+		lines = g->lineComplete();
+		pieces++;
+		PiecePtr used = queue[0];
+		for (int i = 0; i < PREVIEW; i++)
+			queue[i] = queue[i + 1];
+		// the last lock too, so no two places of the queue hold the same piece and a reset has one for each
+		queue[PREVIEW] = next(used);
+		if (!g->lose())
+		{
+			g->start(&queue[0]);
+			setModels();
+		}
+		return lines;
+	}
+
+	void setModels()
+	{
+		if (shader == nullptr)
+			return;
+		glm::mat4 posicaoNextPiece = glm::mat4(g->getModel());
+		posicaoNextPiece = glm::translate(posicaoNextPiece, glm::vec3(15.5f, 21.0f, -10.0f));
+		for (int i = 1; i <= PREVIEW; i++)
+		{
+			queue[i]->setModel(posicaoNextPiece);
+			posicaoNextPiece = glm::translate(posicaoNextPiece, glm::vec3(0.0f, -4.5f, 0.0f));
+		}
+	}
+
+	void draw(Shader s)
+	{
+		TRACE_ZONE("Game::draw");
+		g->draw(s);
+		for (int i = 1; i <= PREVIEW; i++)
+			queue[i]->draw(s);
+	}
+
+	void snapshot(Snapshot *s)
+	{
+		g->snapshot(s);
+		for (int i = 0; i <= PREVIEW; i++)
+		{
+			s->queue[i][0] = (unsigned char)queue[i]->type;
+			s->queue[i][1] = (unsigned char)queue[i]->getRotation();
+		}
+		s->bagSize = (unsigned char)bag.size();
+		for (unsigned int i = 0; i < bag.size(); i++)
+			s->bag[i] = (unsigned char)bag[i];
+		s->seed = seed;
+		s->rngType = random_type.state;
+		s->rngRotation = random_rotation.state;
+		s->assisted = assisted ? 1 : 0;
+	}
+
+	void restore(const Snapshot &s)
+	{
+		for (int i = 0; i <= PREVIEW; i++)
+			queue[i] = newPiece((Piece::types)s.queue[i][0], (Piece::rotation)s.queue[i][1]);
+		bag.clear();
+		for (int i = 0; i < s.bagSize; i++)
+			bag.push_back(s.bag[i]);
+		seed = s.seed;
+		archivable = false;
+		assisted = s.assisted != 0;
+		replay.begin(seed, s.level, (unsigned long long)std::time(nullptr));
+		random_type.state = s.rngType;
+		random_rotation.state = s.rngRotation;
+		g->restore(s, &queue[0]);
+		setModels();
+	}
+
+	// puts the board and the queue of s on screen, for a game that is only drawn (the render thread)
+	// the pieces are turned into the new ones and the replay and the bag are left alone, so nothing is allocated
+	void show(const Snapshot &s)
+	{
+		for (int i = 0; i <= PREVIEW; i++)
+			queue[i]->reset((Piece::types)s.queue[i][0], (Piece::rotation)s.queue[i][1]);
+		g->restore(s, &queue[0]);
+		setModels();
+	}
+
+private:
+	Shader *shader;
+};
+
+#endif // !__game_h
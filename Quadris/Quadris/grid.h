@@ -3,6 +3,9 @@
 
 #include "shader_s.h"
 #include "pieces.h"
+#include "scores.h"
+#include "snapshot.h"
+#include "zobrist.h"
 #include <math.h>
 #include <fstream>
 
@@ -15,6 +18,7 @@ public:
 	{
 		filled = false;
 		color = glm::vec3(0.0f, 0.0f, 0.0f);
+		hash = nullptr;
 	}
 
 	void setPositions(int l, int c)
@@ -23,19 +27,34 @@ public:
 		line = l;
 	}
 
+	// the grid hash this block keeps up to date when it is filled or cleared
+	void setHash(unsigned long long *h)
+	{
+		hash = h;
+	}
+
 	void setColor(glm::vec3 c)
 	{
 		color = c;
 	}
 
+	glm::vec3 getColor()
+	{
+		return color;
+	}
+
 	void fillBlock(glm::vec3 c)
 	{
+		if (!filled && hash != nullptr)
+			*hash ^= Zobrist::keys().cell[line][column];
 		filled = true;
 		setColor(c);
 	}
 
 	void unfillBlock()
 	{
+		if (filled && hash != nullptr)
+			*hash ^= Zobrist::keys().cell[line][column];
 		filled = false;
 	}
 
@@ -62,10 +81,13 @@ public:
 private:
 	glm::vec3 color;
 	int line, column;
+	unsigned long long *hash;
 };
 
 class Grid
 {
+	friend class GridBenchmark;
+
 	struct coord
 	{
 		int x, y;
@@ -111,12 +133,31 @@ public:
 	float scale, fastScale, normalScale;
 
 	Grid(Shader s)
+	{
+		init();
+		setTexture(s);
+		ENDGAME = glfwGetTime();
+	}
+
+	// headless grid, no textures (bots, replays, snapshots)
+	Grid()
+	{
+		init();
+		text1 = text2 = 0;
+		ENDGAME = 0.0;
+	}
+
+	void init()
 	{
 		model = glm::mat4(1.0f);
 		model = glm::translate(model, glm::vec3(-5.0f, -10.0f, 0.0f));
-		for (int l = 0; l < 25; l++)
+		hash = 0;
+		for (int l = 0; l < 28; l++)
 			for (int c = 0; c < 10; c++)
+			{
 				b[l][c].setPositions(l, c);
+				b[l][c].setHash(&hash);
+			}
 
 		scale = normalScale = 1.0f;
 		fastScale = 20.0f;
@@ -126,8 +167,7 @@ public:
 		endgame = false;
 		scaleBack = false;
 		points = 0.0f;
-		setTexture(s);
-		ENDGAME = glfwGetTime();
+		p = nullptr;
 
 		// start positions translated
 		startPositions[(int)Piece::types::L][(int)Piece::rotation::R0].assign(17, 4, 17, 5, 18, 4, 19, 4);
@@ -160,6 +200,16 @@ public:
 		startPositions[(int)Piece::types::T][(int)Piece::rotation::R270].assign(17, 5, 18, 4, 18, 5, 19, 5);
 	}
 
+	// empty again as a new grid, the textures are kept
+	void reset()
+	{
+		for (int l = 0; l < 28; l++)
+			for (int c = 0; c < 10; c++)
+				b[l][c].unfillBlock();
+		init();
+		name[0] = '\0';
+	}
+
 	void setTexture(Shader s)
 	{
 		// load image, create texture and generate mipmaps
@@ -247,7 +297,23 @@ public:
 		}
 	}
 
-	void lineComplete()
+	// outline of where a hint puts the falling piece, drawn like the shadow in white
+	void drawHint(Shader s, const int x[4], const int y[4])
+	{
+		for (int i = 0; i < 4; i++)
+		{
+			glm::mat4 aux_model = glm::translate(model, glm::vec3(0.5f + y[i], 0.5f + x[i], 0.0f));
+			s.setMat4("model", aux_model);
+			s.setVec3("color", glm::vec3(1.0f, 1.0f, 1.0f));
+			s.setBool("shadow", true);
+			glLineWidth(2.0f);
+			glDrawArrays(GL_LINE_LOOP, 0, 6);
+			s.setBool("shadow", false);
+		}
+	}
+
+	// returns how many lines were cleared
+	int lineComplete()
 	{
 		int counter = 0;
 		for (int l = 0; l < 21; l++)
@@ -267,8 +333,11 @@ public:
 				for(int l_aux = l; l_aux < 21; l_aux++)
 					for (int c = 0; c < 10; c++)
 					{
-						b[l_aux][c] = b[l_aux + 1][c];
-						b[l_aux][c].setPositions(l_aux, c);
+						// through fillBlock/unfillBlock so the hash follows the lines coming down
+						if (b[l_aux + 1][c].filled)
+							b[l_aux][c].fillBlock(b[l_aux + 1][c].getColor());
+						else
+							b[l_aux][c].unfillBlock();
 					}
 				l--;
 			}
@@ -290,6 +359,63 @@ public:
 		default:
 			break;
 		}
+		return counter;
+	}
+
+	// the gray of the garbage lines of the versus mode
+	static glm::vec3 garbageColor()
+	{
+		return glm::vec3(0.5f, 0.5f, 0.5f);
+	}
+
+	// versus: lines garbage lines come in at the bottom with a hole at column hole and push the stack up,
+	// the falling piece stays where it is unless the stack reaches it; a stack pushed into the top rows loses
+	void addGarbage(int lines, int hole)
+	{
+		for (int i = 0; i < 4; i++)
+			b[currentPiece.positions[i].x][currentPiece.positions[i].y].unfillBlock();
+		for (int l = 27; l >= lines; l--)
+			for (int c = 0; c < 10; c++)
+			{
+				if (b[l - lines][c].filled)
+					b[l][c].fillBlock(b[l - lines][c].getColor());
+				else
+					b[l][c].unfillBlock();
+			}
+		for (int l = 0; l < lines; l++)
+			for (int c = 0; c < 10; c++)
+			{
+				if (c == hole)
+					b[l][c].unfillBlock();
+				else
+					b[l][c].fillBlock(garbageColor());
+			}
+		for (int l = 21; l < 28; l++)
+			for (int c = 0; c < 10; c++)
+				if (b[l][c].filled)
+					lost = true;
+		// the falling piece goes up out of the way
+		for (bool overlap = true; overlap; )
+		{
+			int top = 0;
+			overlap = false;
+			for (int i = 0; i < 4; i++)
+			{
+				overlap = overlap || b[currentPiece.positions[i].x][currentPiece.positions[i].y].filled;
+				top = currentPiece.positions[i].x > top ? currentPiece.positions[i].x : top;
+			}
+			if (overlap && top == 27)
+			{
+				lost = true;
+				break;
+			}
+			if (overlap)
+				for (int i = 0; i < 4; i++)
+					currentPiece.positions[i].x++;
+		}
+		for (int i = 0; i < 4; i++)
+			b[currentPiece.positions[i].x][currentPiece.positions[i].y].fillBlock((*p)->color);
+		attShadow();
 	}
 
 	bool lose()
@@ -382,6 +508,8 @@ public:
 					}
 					returnVariable = true;
 					i = need? -1 : i;
+					if (i < 0)
+						continue;		// start over, positions[-1] does not exist
 				}
 				if (currentPiece.positions[i].y > 9 || currentPiece.positions[i].y < 0)
 				{
@@ -407,6 +535,8 @@ public:
 						return false;
 					}
 					i = need ? -1 : i;
+					if (i < 0)
+						continue;
 				}
 				if (b[currentPiece.positions[i].x][currentPiece.positions[i].y].filled)
 				{
@@ -637,6 +767,57 @@ public:
 		}
 	}
 
+	// the board without the falling piece, bit c of rows[l] is column c
+	void getBoard(unsigned short rows[28])
+	{
+		for (int l = 0; l < 28; l++)
+		{
+			rows[l] = 0;
+			for (int c = 0; c < 10; c++)
+				if (b[l][c].filled && !currentPiece.contain(l, c))
+					rows[l] |= (unsigned short)(1 << c);
+		}
+	}
+
+	void getPiece(int x[4], int y[4])
+	{
+		for (int i = 0; i < 4; i++)
+		{
+			x[i] = currentPiece.positions[i].x;
+			y[i] = currentPiece.positions[i].y;
+		}
+	}
+
+	Piece::types getType()
+	{
+		return (*p)->type;
+	}
+
+	// the board with the falling piece in it and the type of that piece
+	unsigned long long getHash()
+	{
+		return hash ^ Zobrist::keys().piece[(int)(*p)->type];
+	}
+
+	// the board without the falling piece, the same cells getBoard gives
+	unsigned long long getBoardHash()
+	{
+		unsigned long long h = hash;
+		for (int i = 0; i < 4; i++)
+			h ^= Zobrist::keys().cell[currentPiece.positions[i].x][currentPiece.positions[i].y];
+		return h;
+	}
+
+	// where start() puts a piece on an empty top
+	void getStart(Piece::types t, Piece::rotation r, int x[4], int y[4])
+	{
+		for (int i = 0; i < 4; i++)
+		{
+			x[i] = startPositions[(int)t][(int)r].positions[i].x;
+			y[i] = startPositions[(int)t][(int)r].positions[i].y;
+		}
+	}
+
 	float getPoints()
 	{
 		return points;
@@ -654,17 +835,65 @@ public:
 		fastScale = 2*level + 19.0f;
 	}
 
-	void saveScore()
+	void saveScore(Leaderboard *board)
 	{
 		int i;
 		for (i = 0; name[i] != '\0'; i++);
 		if (i > 1 && points > 0)
+			board->save("scores.sco", ScoreRecord(name, (int)points, level, (long long)std::time(nullptr)));
+	}
+
+	void snapshot(Snapshot *s)
+	{
+		for (int l = 0; l < Snapshot::LINES; l++)
+			for (int c = 0; c < Snapshot::COLUMNS; c++)
+			{
+				int kind = 0;
+				if (b[l][c].filled)
+					for (int t = 0; t < 7; t++)
+						if (b[l][c].getColor() == Piece::colorOf((Piece::types)t))
+							kind = t + 1;
+				if (b[l][c].filled && kind == 0 && b[l][c].getColor() == garbageColor())
+					kind = Snapshot::GARBAGE;
+				s->setCell(l, c, kind);
+			}
+		for (int i = 0; i < 4; i++)
 		{
-			std::ofstream sf;
-			sf.open("scores.sco", std::fstream::app);
-			sf << name << ";" << points << std::endl;
-			sf.close();
+			s->piece[i][0] = (unsigned char)currentPiece.positions[i].x;
+			s->piece[i][1] = (unsigned char)currentPiece.positions[i].y;
+			s->shadow[i][0] = (unsigned char)currentPieceShadow.positions[i].x;
+			s->shadow[i][1] = (unsigned char)currentPieceShadow.positions[i].y;
 		}
+		s->level = (unsigned char)level;
+		s->lost = lost;
+		s->points = (int)points;
+		memcpy(s->name, name, 64);
+	}
+
+	// p is the already restored falling piece
+	void restore(const Snapshot &s, PiecePtr *p)
+	{
+		for (int l = 0; l < Snapshot::LINES; l++)
+			for (int c = 0; c < Snapshot::COLUMNS; c++)
+			{
+				if (s.getCell(l, c) == Snapshot::GARBAGE)
+					b[l][c].fillBlock(garbageColor());
+				else if (s.getCell(l, c) != 0)
+					b[l][c].fillBlock(Piece::colorOf((Piece::types)(s.getCell(l, c) - 1)));
+				else
+					b[l][c].unfillBlock();
+			}
+		for (int i = 0; i < 4; i++)
+		{
+			currentPiece.positions[i].assign(s.piece[i][0], s.piece[i][1]);
+			currentPieceShadow.positions[i].assign(s.shadow[i][0], s.shadow[i][1]);
+		}
+		(this->p) = p;
+		setLevel(s.level);
+		lost = s.lost != 0;
+		points = (float)s.points;
+		memcpy(name, s.name, 64);
+		name[63] = '\0';
 	}
 
 	void setName(char *n)
@@ -675,6 +904,7 @@ public:
 
 private:
 	Block b[28][10];
+	unsigned long long hash;		// zobrist of the filled cells, falling piece included
 	PiecePtr *p;
 	glm::mat4 model;
 	set startPositions[7][4], currentPiece, currentPieceShadow;
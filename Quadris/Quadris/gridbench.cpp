@@ -0,0 +1,15 @@
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <stb_image.h>
+#include <shader_s.h>
+#include "gridbench.h"
+
+#include <cstdlib>
+
+// GridBench.exe [seconds per case] [output.json]: the same run as Quadris.exe --bench-grid, without the game around it
+int main(int argc, char *argv[])
+{
+	return benchmarkGrid(argc > 1 ? atof(argv[1]) : 0.2, argc > 2 ? argv[2] : nullptr);
+}
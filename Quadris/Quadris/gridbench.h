@@ -0,0 +1,194 @@
+#ifndef __gridbench_h
+#define __gridbench_h
+
+#include "allocations.h"
+#include "grid.h"
+#include "pieces.h"
+#include "random.h"
+#include "snapshot.h"
+
+#include <chrono>
+#include <cstdio>
+
+// time, speed and allocations of every Grid operation the game runs per input, on a few boards
+// an operation that changes the board is run until the board has to be put back (a piece that landed, lines cleared),
+// the time of an operation is the loop with its resets in it, the cost of a reset alone and how often one was needed
+// are reported next to it: taking one from the other gives noise, or nothing, when the reset costs more than the operation
+class GridBenchmark
+{
+public:
+	enum fixtures { EMPTY, MIDGAME, NEAR_TOP, FULL_LINES, FIXTURES };
+
+	struct Result
+	{
+		const char *fixture, *op;
+		long long ops;
+		double nsPerOp, opsPerSecond, allocationsPerOp;		// with the resets the operation needed
+		double resetsPerOp, nsPerReset, allocationsPerReset;
+	};
+
+	GridBenchmark(double seconds = 0.2) : piece(new Piece(Piece::types::T, Piece::rotation::R0))
+	{
+		budget = seconds;
+	}
+
+	static const char *fixtureName(int f)
+	{
+		static const char *names[FIXTURES] = { "empty", "midgame", "near_top", "full_lines" };
+		return names[f];
+	}
+
+	// the board of a fixture without the falling piece, holes always in the same places
+	static void fixture(int f, Snapshot *s)
+	{
+		Random random(0x6B1D0000ULL + f);
+		int full = 0, holed = 0;
+		switch (f)
+		{
+		case MIDGAME:
+			holed = 8;
+			break;
+		case NEAR_TOP:
+			holed = 16;
+			break;
+		case FULL_LINES:
+			full = 4;
+			holed = 6;
+			break;
+		default:
+			break;
+		}
+		for (int l = 0; l < full + holed; l++)
+		{
+			int hole = l < full ? -1 : (int)(random() % Snapshot::COLUMNS);
+			for (int c = 0; c < Snapshot::COLUMNS; c++)
+				if (c != hole)
+					s->setCell(l, c, 1 + (int)(random() % 7));
+		}
+		// a ragged line on top of the rest
+		if (f != EMPTY)
+			for (int c = 0; c < Snapshot::COLUMNS; c++)
+				if (random() % 2 == 0)
+					s->setCell(full + holed, c, 1 + (int)(random() % 7));
+	}
+
+	// every operation on every fixture, appended to results
+	int run(Result *results)
+	{
+		int n = 0;
+		for (int f = 0; f < FIXTURES; f++)
+		{
+			Snapshot board;
+			fixture(f, &board);
+			grid.restore(board, &piece);
+			grid.start(&piece);
+			grid.snapshot(&spawned);
+			empty = board;
+
+			Grid::set at;
+			int x[4], y[4];
+			grid.getPiece(x, y);
+			for (int i = 0; i < 4; i++)
+				at.positions[i].assign(x[i], y[i]);
+
+			results[n++] = measure(f, "fall", false, [this](long long) { grid.fall(); return grid.change; });
+			results[n++] = measure(f, "translate", false, [this](long long i) { grid.translate((i & 1) == 0); return false; });
+			results[n++] = measure(f, "rotate", false, [this](long long i) { grid.rotate((i & 1) == 0); return (i & 15) == 15; });
+			results[n++] = measure(f, "colliding", false, [this, at](long long) { grid.colliding(at); return false; });
+			results[n++] = measure(f, "attShadow", false, [this](long long) { grid.attShadow(); return false; });
+			results[n++] = measure(f, "fallAllTheWay", false, [this](long long) { grid.fallAllTheWay(); return true; });
+			results[n++] = measure(f, "lineComplete", false, [this](long long) { grid.lineComplete(); return true; });
+			results[n++] = measure(f, "lose", false, [this](long long) { return grid.lose(); });
+			results[n++] = measure(f, "start", true, [this](long long) { grid.start(&piece); return true; });
+		}
+		return n;
+	}
+
+	static const int RESULTS = FIXTURES * 9;
+
+private:
+	void reset(bool bare)
+	{
+		grid.restore(bare ? empty : spawned, &piece);
+	}
+
+	// op(i) runs the i-th operation and says if the board has to be put back before the next one
+	template <typename Op>
+	Result measure(int f, const char *name, bool bare, Op op)
+	{
+		static const int BATCH = 1000;
+		Result r;
+		long long resets = 0, i = 0;
+		bool dirty = false;
+
+		// the cost of a reset alone
+		long long before = allocations().count;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int k = 0; k < BATCH; k++)
+			reset(bare);
+		double resetSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / BATCH;
+		double resetAllocations = (double)(allocations().count - before) / BATCH;
+
+		reset(bare);
+		before = allocations().count;
+		double seconds = 0.0;
+		start = std::chrono::steady_clock::now();
+		while (seconds < budget)
+		{
+			for (int k = 0; k < BATCH; k++)
+			{
+				if (dirty)
+				{
+					reset(bare);
+					resets++;
+				}
+				dirty = op(i++);
+			}
+			seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		}
+		double allocated = (double)(allocations().count - before);
+
+		r.fixture = fixtureName(f);
+		r.op = name;
+		r.ops = i;
+		r.nsPerOp = seconds * 1e9 / i;
+		r.opsPerSecond = seconds > 0.0 ? i / seconds : 0.0;
+		r.allocationsPerOp = allocated / i;
+		r.resetsPerOp = (double)resets / i;
+		r.nsPerReset = resetSeconds * 1e9;
+		r.allocationsPerReset = resetAllocations;
+		return r;
+	}
+
+	double budget;
+	Grid grid;
+	PiecePtr piece;
+	Snapshot empty, spawned;
+};
+
+// Quadris.exe --bench-grid [seconds per case] [output.json], or GridBench.exe [seconds per case] [output.json]
+// every Grid operation on every fixture as JSON, on stdout when no file is given
+inline int benchmarkGrid(double seconds, const char *path)
+{
+	GridBenchmark benchmark(seconds);
+	GridBenchmark::Result results[GridBenchmark::RESULTS];
+	int count = benchmark.run(results);
+	FILE *out = path != nullptr ? fopen(path, "w") : stdout;
+	if (out == NULL)
+	{
+		printf("could not write %s\n", path);
+		return 1;
+	}
+
+	fprintf(out, "{\n  \"benchmark\": \"grid\",\n  \"seconds_per_case\": %.3f,\n  \"results\": [\n", seconds);
+	for (int i = 0; i < count; i++)
+		fprintf(out, "    {\"fixture\": \"%s\", \"op\": \"%s\", \"ops\": %lld, \"ns_per_op\": %.2f, \"ops_per_sec\": %.0f, \"allocs_per_op\": %.4f, \"resets_per_op\": %.4f, \"ns_per_reset\": %.2f, \"allocs_per_reset\": %.4f}%s\n",
+			results[i].fixture, results[i].op, results[i].ops, results[i].nsPerOp, results[i].opsPerSecond, results[i].allocationsPerOp,
+			results[i].resetsPerOp, results[i].nsPerReset, results[i].allocationsPerReset, i + 1 < count ? "," : "");
+	fprintf(out, "  ]\n}\n");
+	if (out != stdout)
+		fclose(out);
+	return 0;
+}
+
+#endif // !__gridbench_h
@@ -0,0 +1,140 @@
+#ifndef __hint_h
+#define __hint_h
+
+#include "bot.h"
+#include "game.h"
+#include "mailbox.h"
+#include "snapshot.h"
+#include "trace.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// suggests where to put the falling piece while the player is still thinking
+// the game posts a snapshot every time a piece comes in, a thread of its own plays it on a headless copy
+// with the bot, one level deeper and wider each time, and publishes every better answer until the time budget is over
+// a new post stops the search of the old piece between two levels of the bot
+// the thread sleeps on the lock until a post comes, post and take go under it so neither a wake up nor a cancel is lost
+class HintEngine
+{
+public:
+	struct Hint
+	{
+		unsigned int ticket;		// the post it answers
+		Cells cells;
+		int depth;
+	};
+
+	HintEngine(double seconds = 0.3)
+	{
+		budget = seconds;
+		tickets = 0;
+		quit = false;
+		cancel = false;
+		worker = std::thread(&HintEngine::run, this);
+	}
+
+	~HintEngine()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quit = true;
+			cancel = true;
+		}
+		wake.notify_one();
+		worker.join();
+	}
+
+	// from the render thread, returns the ticket its hints will carry
+	unsigned int post(Game *game)
+	{
+		Request &r = requests.slot();
+		game->snapshot(&r.snapshot);
+		r.ticket = ++tickets;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			requests.publish();
+			cancel = true;
+		}
+		wake.notify_one();
+		return tickets;
+	}
+
+	// from the render thread, the newest hint if there is one
+	bool take(Hint *h)
+	{
+		return hints.take(h);
+	}
+
+private:
+	struct Request
+	{
+		Snapshot snapshot;
+		unsigned int ticket;
+	};
+
+	// widths and depths tried one after the other, each about three times the work of the one before
+	static const int STEPS = 6;
+
+	void run()
+	{
+		static const int widths[STEPS] = { 1, 4, 8, 8, 16, 32 }, depths[STEPS] = { 1, 2, 3, 4, 5, Bot::MAX_DEPTH };
+		Game game(nullptr, 0);
+		Bot bot;
+		Replay::action inputs[MoveGenerator::MAX_INPUTS];
+		Request r;
+		bot.cancel = &cancel;
+		Trace::get().nameThread("hint");
+		while (true)
+		{
+			{
+				// the cancel is cleared with the take, a post after it cancels the request taken here
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [this]() { return quit || requests.ready(); });
+				if (quit)
+					return;
+				cancel = false;
+				if (!requests.take(&r))
+					continue;
+			}
+			game.restore(r.snapshot);
+			if (game.g->lost)
+				continue;
+
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			double last = 0.0;
+			for (int step = 0; step < STEPS && !cancel; step++)
+			{
+				double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+				// the next step would not end in time, the answer of this one stays
+				if (step > 0 && elapsed + 3.0 * last > budget)
+					break;
+				bot.setWidth(widths[step]);
+				bot.setDepth(depths[step]);
+				TRACE_ZONE("HintEngine::level");
+				if (bot.plan(&game, inputs) == 0 || cancel)
+					break;
+				Hint &h = hints.slot();
+				h.ticket = r.ticket;
+				h.cells = bot.chosen;
+				h.depth = bot.depth;
+				hints.publish();
+				last = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() - elapsed;
+			}
+		}
+	}
+
+	double budget;
+	unsigned int tickets;			// render thread only
+	Mailbox<Request> requests;
+	Mailbox<Hint> hints;
+	std::atomic<bool> quit, cancel;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::thread worker;
+};
+
+#endif // !__hint_h
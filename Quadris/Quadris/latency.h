@@ -0,0 +1,169 @@
+#ifndef __latency_h
+#define __latency_h
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+// milliseconds in 1 ms buckets, the last bucket holds everything slower
+struct LatencyHistogram
+{
+	static const int BUCKETS = 100;
+
+	long long counts[BUCKETS];
+	long long samples;
+	double sum, max;
+
+	LatencyHistogram()
+	{
+		clear();
+	}
+
+	void clear()
+	{
+		memset(counts, 0, sizeof(counts));
+		samples = 0;
+		sum = max = 0.0;
+	}
+
+	void add(double ms)
+	{
+		int b = ms < 0.0 ? 0 : (int)ms;
+		counts[b < BUCKETS ? b : BUCKETS - 1]++;
+		samples++;
+		sum += ms;
+		if (ms > max)
+			max = ms;
+	}
+
+	double mean() const
+	{
+		return samples > 0 ? sum / samples : 0.0;
+	}
+
+	// upper edge of the bucket holding the p-th fraction of the samples, never above the slowest one
+	double percentile(double p) const
+	{
+		long long wanted = (long long)(p * samples), seen = 0;
+		for (int b = 0; b < BUCKETS; b++)
+		{
+			seen += counts[b];
+			if (seen > wanted)
+				return b + 1.0 < max ? b + 1.0 : max;
+		}
+		return max;
+	}
+};
+
+// input to photon: a key press is stamped when GLFW hands it to the key callback, the simulation step that uses it
+// tags it if the board changed, the tag goes with the next frame published and is closed with the times that frame
+// (or a later one holding it) was handed to glfwSwapBuffers and came back from it
+// polling (processInput) and event handlers go the same way: pressed from the callback, consumed where the move is applied
+// every call is made from the main thread, with --render-thread the swap times come back from the render thread
+// with vsync on the return of glfwSwapBuffers is the closest the game gets to the photons
+class InputLatency
+{
+public:
+	static const int KEYS = 512;				// above GLFW_KEY_LAST
+	static const int MAX_TAGGED = 16;			// inputs waiting to be shown
+	static constexpr double MAX_AGE = 0.25;		// seconds, an older stamp was a press nobody used
+
+	LatencyHistogram submit, present;		// from the press to glfwSwapBuffers being called, to it returning
+
+	InputLatency()
+	{
+		clear();
+	}
+
+	void clear()
+	{
+		for (int k = 0; k < KEYS; k++)
+			stamps[k] = -1.0;
+		tagged = 0;
+		submit.clear();
+		present.clear();
+	}
+
+	// from the key callback, t in glfwGetTime seconds
+	void pressed(int key, double t)
+	{
+		if (key >= 0 && key < KEYS)
+			stamps[key] = t;
+	}
+
+	// where the input is applied; a press that did not change the board is dropped
+	void consumed(int key, bool changed, double t)
+	{
+		if (key < 0 || key >= KEYS || stamps[key] < 0.0)
+			return;
+		if (changed && t - stamps[key] <= MAX_AGE && tagged < MAX_TAGGED)
+		{
+			inputs[tagged].stamp = stamps[key];
+			inputs[tagged].frame = -1;
+			tagged++;
+		}
+		stamps[key] = -1.0;
+	}
+
+	// the inputs consumed since the last call first show up in frame
+	void published(long long frame)
+	{
+		for (int i = 0; i < tagged; i++)
+			if (inputs[i].frame < 0)
+				inputs[i].frame = frame;
+	}
+
+	// frame was handed to glfwSwapBuffers at submitted and came back at swapped, closes its inputs and those of older frames
+	void shown(long long frame, double submitted, double swapped)
+	{
+		int kept = 0;
+		for (int i = 0; i < tagged; i++)
+		{
+			if (inputs[i].frame >= 0 && inputs[i].frame <= frame)
+			{
+				submit.add((submitted - inputs[i].stamp) * 1000.0);
+				present.add((swapped - inputs[i].stamp) * 1000.0);
+			}
+			else
+				inputs[kept++] = inputs[i];
+		}
+		tagged = kept;
+	}
+
+	// appends both histograms to path, nothing when no input was measured
+	bool log(const char *path)
+	{
+		if (present.samples == 0)
+			return true;
+		FILE *f = fopen(path, "a");
+		if (f == NULL)
+			return false;
+		fprintf(f, "%lld inputs measured at %lld\n", present.samples, (long long)std::time(nullptr));
+		write(f, "press -> submit", submit);
+		write(f, "press -> swap", present);
+		return fclose(f) == 0;
+	}
+
+private:
+	static void write(FILE *f, const char *name, const LatencyHistogram &h)
+	{
+		fprintf(f, "  %s: mean %.2f ms, p50 %.0f, p95 %.0f, p99 %.0f, max %.2f\n   ", name, h.mean(), h.percentile(0.5), h.percentile(0.95),
+			h.percentile(0.99), h.max);
+		for (int b = 0; b < LatencyHistogram::BUCKETS; b++)
+			if (h.counts[b] > 0)
+				fprintf(f, " %d%s:%lld", b, b + 1 < LatencyHistogram::BUCKETS ? "" : "+", h.counts[b]);
+		fprintf(f, "\n");
+	}
+
+	struct Tag
+	{
+		double stamp;
+		long long frame;					// -1 until it is published
+	};
+
+	double stamps[KEYS];					// glfwGetTime of the last press not used yet, -1 when none
+	Tag inputs[MAX_TAGGED];					// inputs that changed the board and were not shown yet
+	int tagged;
+};
+
+#endif // !__latency_h
@@ -0,0 +1,62 @@
+#ifndef __mailbox_h
+#define __mailbox_h
+
+#include <atomic>
+
+// one value passed from a thread to another without locks: the writer never waits and the reader gets the newest
+// three buffers, one the writer fills, one the reader holds and one in the middle, swapped with an atomic exchange
+template <typename T>
+class Mailbox
+{
+public:
+	Mailbox()
+	{
+		back = 0;
+		middle = 1;
+		front = 2;
+	}
+
+	// writer: fill slot(), then publish it
+	T& slot()
+	{
+		return buffers[back];
+	}
+
+	void publish()
+	{
+		back = middle.exchange(back | FRESH) & ~FRESH;
+	}
+
+	// reader: anything published since the last take
+	bool ready() const
+	{
+		return (middle.load() & FRESH) != 0;
+	}
+
+	bool take(T *out)
+	{
+		T *newest = latest();
+		if (newest == nullptr)
+			return false;
+		*out = *newest;
+		return true;
+	}
+
+	// reader: the same without the copy, the value is read where it is and stays the reader's until the next call
+	T *latest()
+	{
+		if (!ready())
+			return nullptr;
+		front = middle.exchange(front) & ~FRESH;
+		return &buffers[front];
+	}
+
+private:
+	static const unsigned int FRESH = 4;
+
+	T buffers[3];
+	unsigned int back, front;
+	std::atomic<unsigned int> middle;
+};
+
+#endif // !__mailbox_h
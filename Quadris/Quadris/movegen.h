@@ -0,0 +1,534 @@
+#ifndef __movegen_h
+#define __movegen_h
+
+#include "pieces.h"
+#include "grid.h"
+#include "replay.h"
+#include "zobrist.h"
+
+#include <cstring>
+#include <math.h>
+
+// the four blocks of a piece, x is the line and y the column like in Grid
+struct Cells
+{
+	int x[4], y[4];
+
+	bool contain(int l, int c) const
+	{
+		for (int i = 0; i < 4; i++)
+			if (x[i] == l && y[i] == c)
+				return true;
+		return false;
+	}
+
+	// rotation is not stored anywhere in Grid, the shape and where it is say everything
+	unsigned int key() const
+	{
+		int minX = x[0], minY = y[0];
+		unsigned int pattern = 0;
+		for (int i = 1; i < 4; i++)
+		{
+			minX = x[i] < minX ? x[i] : minX;
+			minY = y[i] < minY ? y[i] : minY;
+		}
+		for (int i = 0; i < 4; i++)
+			pattern |= 1u << ((x[i] - minX) * 4 + (y[i] - minY));
+		return pattern | ((unsigned int)minX << 16) | ((unsigned int)minY << 21);
+	}
+};
+
+// what Bitboard::make needs to take a piece back: its cells, the lines it cleared and the hash before it
+struct Undo
+{
+	Cells cells;
+	unsigned int cleared;		// bit l: line l was full and cleared, numbered as before the clear
+	int lines, points;			// points: what Grid::lineComplete adds for those lines
+	unsigned long long hash;
+};
+
+// preallocated, a search pushes one Undo for every piece it tries and pops it when it takes the piece back
+class UndoStack
+{
+public:
+	static const int SIZE = 64;
+
+	UndoStack()
+	{
+		top = 0;
+	}
+
+	Undo* push()
+	{
+		return &entries[top++];
+	}
+
+	const Undo& pop()
+	{
+		return entries[--top];
+	}
+
+	int size()
+	{
+		return top;
+	}
+
+private:
+	Undo entries[SIZE];
+	int top;
+};
+
+// the board as one bit per cell, the falling piece not included
+// the moves are the ones Grid does (translate, fall, rotate with its kicks) but without touching Blocks,
+// so the generator reaches exactly what a player can
+struct Bitboard
+{
+	static const int LINES = 28;
+	unsigned short rows[LINES];
+	unsigned long long hash;		// zobrist of the filled cells, kept up to date by place and clearLines
+
+	bool filled(int l, int c) const
+	{
+		if (l < 0 || l >= LINES || c < 0 || c > 9)
+			return true;
+		return (rows[l] >> c) & 1;
+	}
+
+	void place(const Cells &p)
+	{
+		for (int i = 0; i < 4; i++)
+		{
+			rows[p.x[i]] |= (unsigned short)(1 << p.y[i]);
+			hash ^= Zobrist::keys().cell[p.x[i]][p.y[i]];
+		}
+	}
+
+	static unsigned long long rowHash(int l, unsigned int bits)
+	{
+		unsigned long long h = 0;
+		for (int c = 0; bits != 0; c++, bits >>= 1)
+			if (bits & 1)
+				h ^= Zobrist::keys().cell[l][c];
+		return h;
+	}
+
+	// Grid::lineComplete, returns the lines cleared
+	int clearLines(unsigned int *cleared = nullptr)
+	{
+		int counter = 0;
+		for (int l = 0; l < 21; l++)
+			if (rows[l] == 0x3FF)
+			{
+				if (cleared != nullptr)
+					*cleared |= 1u << (l + counter);
+				counter++;
+				for (int l_aux = l; l_aux < 21; l_aux++)
+				{
+					hash ^= rowHash(l_aux, rows[l_aux] ^ rows[l_aux + 1]);
+					rows[l_aux] = rows[l_aux + 1];
+				}
+				l--;
+			}
+		return counter;
+	}
+
+	static int pointsFor(int lines, int level)
+	{
+		static const int table[5] = { 0, 40, 100, 300, 1200 };
+		return lines >= 0 && lines <= 4 ? table[lines] * (level + 1) : 0;
+	}
+
+	// places p and clears the lines it completes, u is filled with what unmake needs
+	// nothing is copied, a search goes down with make and back up with unmake on the same board
+	int make(const Cells &p, int level, Undo *u)
+	{
+		u->cells = p;
+		u->hash = hash;
+		u->cleared = 0;
+		place(p);
+		u->lines = clearLines(&u->cleared);
+		u->points = pointsFor(u->lines, level);
+		return u->lines;
+	}
+
+	void unmake(const Undo &u)
+	{
+		if (u.cleared != 0)
+		{
+			// the lines left go back over the full ones, line 21 and above never moved
+			int from = 20 - u.lines;
+			for (int l = 20; l >= 0; l--)
+				rows[l] = (u.cleared >> l) & 1 ? 0x3FF : rows[from--];
+		}
+		for (int i = 0; i < 4; i++)
+			rows[u.cells.x[i]] &= (unsigned short)~(1 << u.cells.y[i]);
+		hash = u.hash;
+	}
+
+	// Grid::lose
+	bool lose() const
+	{
+		return (rows[21] | rows[22] | rows[23]) != 0;
+	}
+
+	// Grid::start, p comes with the start positions and is pushed up until it fits
+	// false when the piece does not fit or starts too high, the game is lost then
+	bool spawn(Cells *p) const
+	{
+		for (int offset = 0; offset <= 4; offset++)
+		{
+			bool free = true;
+			for (int i = 0; i < 4 && free; i++)
+				free = !filled(p->x[i] + offset, p->y[i]);
+			if (free)
+			{
+				int minX = p->x[0] + offset;
+				for (int i = 0; i < 4; i++)
+				{
+					p->x[i] += offset;
+					minX = p->x[i] < minX ? p->x[i] : minX;
+				}
+				return minX <= 20;
+			}
+		}
+		return false;
+	}
+
+	bool translate(Cells *p, bool right) const
+	{
+		int d = right ? 1 : -1;
+		for (int i = 0; i < 4; i++)
+			if (p->y[i] == (right ? 9 : 0) || filled(p->x[i], p->y[i] + d))
+				return false;
+		for (int i = 0; i < 4; i++)
+			p->y[i] += d;
+		return true;
+	}
+
+	// true when the piece could not go down
+	bool fall(Cells *p) const
+	{
+		Cells initial = *p;
+		for (int i = 0; i < 4; i++)
+			p->x[i]--;
+		return colliding(p, initial);
+	}
+
+	void drop(Cells *p) const
+	{
+		while (!fall(p));
+	}
+
+	void rotate(Cells *p, Piece::types t, bool clockwise) const
+	{
+		if (Piece::types::O == t)
+			return;
+		glm::mat2 r;
+		glm::vec2 v, origen;
+		Cells initial = *p;
+		if (Piece::types::I == t)
+			r = { {0, 1}, {-1, 0} };
+		else if (clockwise)
+			r = { {0, -1}, {1, 0} };
+		else
+			r = { {0, 1}, {-1, 0} };
+		if (Piece::types::S == t || Piece::types::Z == t)
+		{
+			r = { {0, -1}, {1, 0} };
+			origen.x = (float)floor((p->x[0] + p->x[1] + p->x[2] + p->x[3]) / 4.0f);
+			origen.y = (float)round((p->y[0] + p->y[1] + p->y[2] + p->y[3]) / 4.0f);
+		}
+		else
+		{
+			origen.x = (float)round((p->x[0] + p->x[1] + p->x[2] + p->x[3]) / 4.0f);
+			origen.y = (float)round((p->y[0] + p->y[1] + p->y[2] + p->y[3]) / 4.0f);
+		}
+		for (int i = 0; i < 4; i++)
+		{
+			v.x = p->x[i] - origen.x;
+			v.y = p->y[i] - origen.y;
+			p->x[i] = (int)(origen.x + r[0][0] * v.x + r[0][1] * v.y);
+			p->y[i] = (int)(origen.y + r[1][0] * v.x + r[1][1] * v.y);
+		}
+		colliding(p, initial);
+		if ((int)t >= 2 && (int)t <= 5 && clockwise)
+			translate(p, false);
+	}
+
+	// same kicks as Grid::colliding
+	bool colliding(Cells *p, const Cells &ini) const
+	{
+		bool right, left, up, down, need, returnVariable;
+		right = left = up = down = returnVariable = false;
+		for (int i = 0; i < 4; i++)
+		{
+			need = false;
+			if (p->x[i] > 24 || p->x[i] < 0)
+			{
+				int direction = p->x[i] - ini.x[i];
+				if (direction > 0)
+				{
+					direction = 1;
+					down = need = true;
+				}
+				else if (direction < 0)
+				{
+					direction = -1;
+					up = need = true;
+				}
+				for (int j = 0; j < 4; j++)
+					p->x[j] -= direction;
+				if (up && down)
+				{
+					*p = ini;
+					return true;
+				}
+				returnVariable = true;
+				if (need)
+				{
+					i = -1;
+					continue;
+				}
+			}
+			if (p->y[i] > 9 || p->y[i] < 0)
+			{
+				int direction = p->y[i] - ini.y[i];
+				if (direction > 0)
+				{
+					direction = 1;
+					left = need = true;
+				}
+				else if (direction < 0)
+				{
+					direction = -1;
+					right = need = true;
+				}
+				for (int j = 0; j < 4; j++)
+					p->y[j] -= direction;
+				if (right && left)
+				{
+					*p = ini;
+					return false;
+				}
+				if (need)
+				{
+					i = -1;
+					continue;
+				}
+			}
+			if (filled(p->x[i], p->y[i]))
+			{
+				int dx = p->x[i] - ini.x[i], dy;
+				if (dx != 0)
+				{
+					if (dx > 0)
+						down = need = true;
+					else
+						up = need = returnVariable = true;
+					dx = dx > 0 ? 1 : -1;
+					for (int j = 0; j < 4; j++)
+						p->x[j] -= dx;
+				}
+				else
+				{
+					dy = p->y[i] - ini.y[i];
+					if (dy > 0)
+					{
+						dy = 1;
+						left = need = true;
+					}
+					else if (dy < 0)
+					{
+						dy = -1;
+						right = need = true;
+					}
+					for (int j = 0; j < 4; j++)
+						p->y[j] -= dy;
+				}
+				if (up && down)
+				{
+					*p = ini;
+					return true;
+				}
+				else if (right && left)
+				{
+					*p = ini;
+					return false;
+				}
+				i = need ? -1 : i;
+			}
+		}
+		return returnVariable;
+	}
+};
+
+// every final placement the falling piece can reach, found by a BFS over piece positions
+// the BFS uses only the moves a player has, so tucks and spins under overhangs come out too
+// each placement keeps its shortest input sequence, ending in HARD_DROP or LOCK
+// all storage is fixed, nothing is allocated while generating
+class MoveGenerator
+{
+public:
+	static const int MAX_NODES = 2048;
+	static const int MAX_PLACEMENTS = 512;
+	static const int MAX_INPUTS = 64;
+	static const int TABLE = 4096;			// power of two, more than MAX_NODES
+
+	struct Placement
+	{
+		Cells cells;
+		int node;							// BFS node it is reached from
+		Replay::action last;				// HARD_DROP from that node, or LOCK when it is already grounded
+		int length;							// inputs, last one included
+	};
+
+	Placement placements[MAX_PLACEMENTS];
+	int count;
+
+	MoveGenerator()
+	{
+		count = 0;
+		generation = 0;
+		memset(visited, 0, sizeof(visited));
+		memset(found, 0, sizeof(found));
+	}
+
+	int generate(Grid *g)
+	{
+		Bitboard board;
+		Cells start;
+		g->getBoard(board.rows);
+		board.hash = g->getBoardHash();
+		g->getPiece(start.x, start.y);
+		return generate(board, start, g->getType());
+	}
+
+	int generate(const Bitboard &board, const Cells &start, Piece::types t)
+	{
+		static const Replay::action moves[5] = { Replay::action::LEFT, Replay::action::RIGHT, Replay::action::ROTATE_CW, Replay::action::ROTATE_CCW, Replay::action::FALL };
+		int head = 0, tail = 0;
+		count = 0;
+		// entries of older calls carry an older generation, so the tables never need clearing
+		if (++generation == 0)
+		{
+			memset(visited, 0, sizeof(visited));
+			memset(found, 0, sizeof(found));
+			generation = 1;
+		}
+
+		push(start, -1, Replay::action::FALL, 0, &tail);
+		while (head < tail)
+		{
+			Node n = nodes[head];
+			Cells landed = n.cells;
+			bool grounded = board.fall(&landed);
+
+			// dropping from here, or locking in place when it cannot go further down
+			if (grounded)
+				addPlacement(n.cells, head, Replay::action::LOCK, n.depth + 1);
+			else
+			{
+				board.drop(&landed);
+				addPlacement(landed, head, Replay::action::HARD_DROP, n.depth + 1);
+			}
+
+			for (int m = 0; m < 5 && n.depth + 2 < MAX_INPUTS; m++)
+			{
+				Cells next = n.cells;
+				switch (moves[m])
+				{
+				case Replay::action::LEFT:
+					board.translate(&next, false);
+					break;
+				case Replay::action::RIGHT:
+					board.translate(&next, true);
+					break;
+				case Replay::action::ROTATE_CW:
+					board.rotate(&next, t, true);
+					break;
+				case Replay::action::ROTATE_CCW:
+					board.rotate(&next, t, false);
+					break;
+				default:
+					if (grounded)
+						continue;
+					board.fall(&next);
+					break;
+				}
+				push(next, head, moves[m], n.depth + 1, &tail);
+			}
+			head++;
+		}
+		return count;
+	}
+
+	// writes the inputs for placement i into out (MAX_INPUTS long), returns how many
+	int sequence(int i, Replay::action *out)
+	{
+		int length = placements[i].length;
+		out[length - 1] = placements[i].last;
+		for (int n = placements[i].node, at = length - 2; n > 0; n = nodes[n].parent, at--)
+			out[at] = nodes[n].move;
+		return length;
+	}
+
+private:
+	struct Node
+	{
+		Cells cells;
+		int parent, depth;
+		Replay::action move;
+	};
+
+	void push(const Cells &c, int parent, Replay::action move, int depth, int *tail)
+	{
+		unsigned int key = c.key(), h;
+		if (*tail >= MAX_NODES)
+			return;
+		for (h = hash(key); visited[h].generation == generation; h = (h + 1) & (TABLE - 1))
+			if (visited[h].key == key)
+				return;
+		visited[h].key = key;
+		visited[h].generation = generation;
+		nodes[*tail].cells = c;
+		nodes[*tail].parent = parent;
+		nodes[*tail].depth = depth;
+		nodes[*tail].move = move;
+		(*tail)++;
+	}
+
+	// BFS goes by depth, the first time a placement shows up is the shortest way there
+	void addPlacement(const Cells &c, int node, Replay::action last, int length)
+	{
+		unsigned int key = c.key(), h;
+		if (count >= MAX_PLACEMENTS)
+			return;
+		for (h = hash(key); found[h].generation == generation; h = (h + 1) & (TABLE - 1))
+			if (found[h].key == key)
+				return;
+		found[h].key = key;
+		found[h].generation = generation;
+		placements[count].cells = c;
+		placements[count].node = node;
+		placements[count].last = last;
+		placements[count].length = length;
+		count++;
+	}
+
+	static unsigned int hash(unsigned int key)
+	{
+		key *= 0x9E3779B1u;
+		return (key >> 20) & (TABLE - 1);
+	}
+
+	struct Entry
+	{
+		unsigned int key, generation;
+	};
+
+	Node nodes[MAX_NODES];
+	Entry visited[TABLE], found[TABLE];
+	unsigned int generation;
+};
+
+#endif // !__movegen_h
@@ -0,0 +1,540 @@
+#ifndef __network_h
+#define __network_h
+
+#include "evaluator.h"
+#include "random.h"
+#include "snapshot.h"
+
+#include <cstdio>
+#include <cstring>
+#include <math.h>
+#include <string>
+#include <vector>
+
+// a small multilayer perceptron that scores boards in place of Evaluator, to try learned evaluations in the bot
+// the inputs are either the cells of lines 0 to 19 or the column heights and the Evaluator features,
+// hidden layers use ReLU and the last layer is one linear output, higher is better like Evaluator
+// weights are floats or int8 with a scale per neuron; int8 layers take their inputs as int16 with a scale per board,
+// so a dot product is a multiply and add of 16 bit pairs into 32 bit sums that never overflow
+// the first layer over cells only adds the weight columns of the filled cells, in int16 for int8 weights
+// the other layers go 4 boards at a time so every weight loaded is used 4 times
+// file: "QNET", version, inputs, precision, layer count, the sizes, then per layer the scales (int8 only),
+// the weights neuron by neuron and the biases, all little endian
+class Network
+{
+public:
+	static const unsigned int VERSION = 1;
+	static const int MAX_LAYERS = 4;
+	static const int MAX_NEURONS = 256;
+	static const int LINES = 20;
+	static const int CELLS = LINES * 10;
+	static const int FEATURES = 16;				// 10 column heights and the 6 of Evaluator::Features
+	static const int TILE = 4;
+
+	enum class inputs { FEATURES, CELLS };
+	enum class precision { FLOAT, INT8 };
+
+	Network()
+	{
+		layers = 0;
+		kind = inputs::CELLS;
+		mode = precision::FLOAT;
+	}
+
+	bool ready() const
+	{
+		return layers > 0;
+	}
+
+	inputs getInputs() const
+	{
+		return kind;
+	}
+
+	precision getPrecision() const
+	{
+		return mode;
+	}
+
+	// hidden: the size of each hidden layer, the output layer is added
+	bool randomize(inputs in, precision p, const int *hidden, int count, unsigned long long seed)
+	{
+		Random random(seed);
+		if (count < 0 || count + 1 > MAX_LAYERS)
+			return false;
+		kind = in;
+		mode = p;
+		layers = count + 1;
+		for (int l = 0; l < layers; l++)
+		{
+			Layer &layer = net[l];
+			layer.inputs = l == 0 ? (in == inputs::CELLS ? CELLS : FEATURES) : hidden[l - 1];
+			layer.outputs = l == count ? 1 : hidden[l];
+			if (layer.outputs < 1 || layer.outputs > MAX_NEURONS)
+				return invalid();
+			layer.weights.resize(layer.inputs * layer.outputs);
+			layer.biases.assign(layer.outputs, 0.0f);
+			// He initialization, uniform with the same variance
+			float range = sqrtf(6.0f / layer.inputs);
+			for (unsigned int i = 0; i < layer.weights.size(); i++)
+				layer.weights[i] = ((random() >> 8) / 16777216.0f * 2.0f - 1.0f) * range;
+			layer.quantized.clear();
+		}
+		prepare();
+		return true;
+	}
+
+	bool save(const char *path) const
+	{
+		std::string temporary = std::string(path) + ".tmp";
+		FILE *f = fopen(temporary.c_str(), "wb");
+		unsigned int header[4] = { VERSION, (unsigned int)kind, (unsigned int)mode, (unsigned int)layers };
+		bool ok;
+		if (f == NULL)
+			return false;
+		ok = fwrite("QNET", 4, 1, f) == 1 && fwrite(header, sizeof(header), 1, f) == 1;
+		for (int l = 0; ok && l < layers; l++)
+			ok = fwrite(&net[l].inputs, sizeof(int), 1, f) == 1;
+		if (ok && layers > 0)
+			ok = fwrite(&net[layers - 1].outputs, sizeof(int), 1, f) == 1;
+		for (int l = 0; ok && l < layers; l++)
+		{
+			const Layer &layer = net[l];
+			if (mode == precision::INT8)
+				ok = fwrite(layer.scales.data(), sizeof(float), layer.outputs, f) == (size_t)layer.outputs
+					&& fwrite(layer.quantized.data(), 1, layer.quantized.size(), f) == layer.quantized.size();
+			else
+				ok = fwrite(layer.weights.data(), sizeof(float), layer.weights.size(), f) == layer.weights.size();
+			ok = ok && fwrite(layer.biases.data(), sizeof(float), layer.outputs, f) == (size_t)layer.outputs;
+		}
+		ok = fclose(f) == 0 && ok;
+		return ok && replaceFile(temporary.c_str(), path);
+	}
+
+	bool load(const char *path)
+	{
+		FILE *f = fopen(path, "rb");
+		char magic[4];
+		unsigned int header[4];
+		int sizes[MAX_LAYERS + 1];
+		bool ok;
+		if (f == NULL)
+			return false;
+		ok = fread(magic, 4, 1, f) == 1 && memcmp(magic, "QNET", 4) == 0 && fread(header, sizeof(header), 1, f) == 1
+			&& header[0] == VERSION && header[1] <= 1 && header[2] <= 1 && header[3] >= 1 && header[3] <= (unsigned int)MAX_LAYERS;
+		if (ok)
+		{
+			kind = (inputs)header[1];
+			mode = (precision)header[2];
+			layers = (int)header[3];
+			ok = fread(sizes, sizeof(int), layers + 1, f) == (size_t)(layers + 1)
+				&& sizes[0] == (kind == inputs::CELLS ? CELLS : FEATURES) && sizes[layers] == 1;
+		}
+		for (int l = 0; ok && l < layers; l++)
+		{
+			Layer &layer = net[l];
+			ok = sizes[l + 1] >= 1 && sizes[l + 1] <= MAX_NEURONS;
+			if (!ok)
+				break;
+			layer.inputs = sizes[l];
+			layer.outputs = sizes[l + 1];
+			layer.weights.resize(layer.inputs * layer.outputs);
+			layer.biases.resize(layer.outputs);
+			if (mode == precision::INT8)
+			{
+				layer.scales.resize(layer.outputs);
+				layer.quantized.resize(layer.weights.size());
+				ok = fread(layer.scales.data(), sizeof(float), layer.outputs, f) == (size_t)layer.outputs
+					&& fread(layer.quantized.data(), 1, layer.quantized.size(), f) == layer.quantized.size();
+				for (unsigned int i = 0; ok && i < layer.weights.size(); i++)
+					layer.weights[i] = layer.quantized[i] * layer.scales[i / layer.inputs];
+			}
+			else
+				ok = fread(layer.weights.data(), sizeof(float), layer.weights.size(), f) == layer.weights.size();
+			ok = ok && fread(layer.biases.data(), sizeof(float), layer.outputs, f) == (size_t)layer.outputs;
+		}
+		fclose(f);
+		if (!ok)
+			return invalid();
+		prepare();
+		return true;
+	}
+
+	// the first count boards of batch, out gets one value for each
+	void evaluate(const Evaluator::Batch &batch, int count, float *out) const
+	{
+		for (int i = 0; i < count; i += TILE)
+			forward(&batch.rows[0][i], Evaluator::CAPACITY, count - i < TILE ? count - i : TILE, out + i);
+	}
+
+	float evaluate(const Bitboard &b) const
+	{
+		float out;
+		forward(b.rows, 1, 1, &out);
+		return out;
+	}
+
+private:
+	struct Layer
+	{
+		int inputs, outputs;
+		int stride;						// inputs rounded up to 16, what a row of rows and a vector of inputs take
+		std::vector<float> weights;		// weights[o * inputs + i], as in the file
+		std::vector<float> biases;
+		std::vector<float> scales;		// int8: weight = quantized * scales[o]
+		std::vector<signed char> quantized;
+
+		// what inference reads, padded with zeros
+		std::vector<float> rows;		// rows[o * stride + i]
+		std::vector<short> qrows;
+		std::vector<float> columns;		// first layer over cells: columns[i * next + o], next = outputs rounded up to 16
+		std::vector<short> qcolumns;
+	};
+
+	static int round16(int n)
+	{
+		return (n + 15) & ~15;
+	}
+
+	bool invalid()
+	{
+		layers = 0;
+		return false;
+	}
+
+	// the int8 weights and every padded copy inference needs
+	void prepare()
+	{
+		for (int l = 0; l < layers; l++)
+		{
+			Layer &layer = net[l];
+			int next = round16(layer.outputs);
+			layer.stride = round16(layer.inputs);
+			if (mode == precision::INT8 && layer.quantized.empty())
+			{
+				layer.scales.assign(layer.outputs, 1.0f);
+				layer.quantized.resize(layer.weights.size());
+				for (int o = 0; o < layer.outputs; o++)
+				{
+					float largest = 0.0f;
+					for (int i = 0; i < layer.inputs; i++)
+						largest = fabsf(layer.weights[o * layer.inputs + i]) > largest ? fabsf(layer.weights[o * layer.inputs + i]) : largest;
+					if (largest > 0.0f)
+						layer.scales[o] = largest / 127.0f;
+					for (int i = 0; i < layer.inputs; i++)
+						layer.quantized[o * layer.inputs + i] = (signed char)floorf(layer.weights[o * layer.inputs + i] / layer.scales[o] + 0.5f);
+				}
+			}
+			layer.rows.assign(layer.outputs * layer.stride, 0.0f);
+			layer.qrows.assign(mode == precision::INT8 ? layer.outputs * layer.stride : 0, 0);
+			layer.columns.assign(l == 0 && kind == inputs::CELLS ? layer.inputs * next : 0, 0.0f);
+			layer.qcolumns.assign(l == 0 && kind == inputs::CELLS && mode == precision::INT8 ? layer.inputs * next : 0, 0);
+			for (int o = 0; o < layer.outputs; o++)
+				for (int i = 0; i < layer.inputs; i++)
+				{
+					float w = layer.weights[o * layer.inputs + i];
+					layer.rows[o * layer.stride + i] = w;
+					if (!layer.qrows.empty())
+						layer.qrows[o * layer.stride + i] = layer.quantized[o * layer.inputs + i];
+					if (!layer.columns.empty())
+						layer.columns[i * next + o] = w;
+					if (!layer.qcolumns.empty())
+						layer.qcolumns[i * next + o] = layer.quantized[o * layer.inputs + i];
+				}
+		}
+	}
+
+	// boards k < n, line l of board k at rows[l * pitch + k]
+	void forward(const unsigned short *rows, int pitch, int n, float *out) const
+	{
+		alignas(32) float a[TILE][MAX_NEURONS], b[TILE][MAX_NEURONS];
+		float (*x)[MAX_NEURONS] = a, (*y)[MAX_NEURONS] = b, (*swap)[MAX_NEURONS];
+		int l = 0;
+		if (!ready())
+		{
+			for (int k = 0; k < n; k++)
+				out[k] = 0.0f;
+			return;
+		}
+		// a tile that is not full still goes through whole, on zeros
+		if (n < TILE)
+		{
+			memset(a, 0, sizeof(a));
+			memset(b, 0, sizeof(b));
+		}
+		if (kind == inputs::CELLS)
+		{
+			for (int k = 0; k < n; k++)
+				cells(rows, pitch, k, y[k]);
+			swap = x;
+			x = y;
+			y = swap;
+			l = 1;
+		}
+		else
+			for (int k = 0; k < n; k++)
+				features(rows, pitch, k, x[k]);
+		for (; l < layers; l++)
+		{
+			dense(net[l], x, y, l == layers - 1);
+			swap = x;
+			x = y;
+			y = swap;
+		}
+		for (int k = 0; k < n; k++)
+			out[k] = x[k][0];
+	}
+
+	// the first layer over cells: the columns of the filled cells added up
+	void cells(const unsigned short *rows, int pitch, int k, float *y) const
+	{
+		const Layer &layer = net[0];
+		int next = round16(layer.outputs);
+		if (mode == precision::INT8)
+		{
+			alignas(32) short sums[MAX_NEURONS];
+			memset(sums, 0, next * sizeof(short));
+			for (int l = 0; l < LINES; l++)
+				for (unsigned int row = rows[l * pitch + k]; row != 0; row &= row - 1)
+					add(sums, &layer.qcolumns[(l * 10 + lowest(row)) * next], next);
+			for (int o = 0; o < layer.outputs; o++)
+				y[o] = sums[o] * layer.scales[o] + layer.biases[o];
+		}
+		else
+		{
+			memset(y, 0, next * sizeof(float));
+			for (int l = 0; l < LINES; l++)
+				for (unsigned int row = rows[l * pitch + k]; row != 0; row &= row - 1)
+					add(y, &layer.columns[(l * 10 + lowest(row)) * next], next);
+			for (int o = 0; o < layer.outputs; o++)
+				y[o] += layer.biases[o];
+		}
+		activate(y, layer.outputs, next, layers == 1);
+	}
+
+	void features(const unsigned short *rows, int pitch, int k, float *x) const
+	{
+		Bitboard b;
+		Evaluator::Features f;
+		memset(b.rows, 0, sizeof(b.rows));
+		for (int l = 0; l < Evaluator::ROWS; l++)
+			b.rows[l] = rows[l * pitch + k];
+		Evaluator::features(b, &f);
+		// a column gets its height from the highest line that fills it
+		for (int c = 0; c < 10; c++)
+			x[c] = 0.0f;
+		for (unsigned int l = Evaluator::ROWS, covered = 0; l > 0; l--)
+		{
+			for (unsigned int top = b.rows[l - 1] & ~covered; top != 0; top &= top - 1)
+				x[lowest(top)] = (float)l;
+			covered |= b.rows[l - 1];
+		}
+		x[10] = (float)f.height;
+		x[11] = (float)f.holes;
+		x[12] = (float)f.bumpiness;
+		x[13] = (float)f.wells;
+		x[14] = (float)f.rowTransitions;
+		x[15] = (float)f.columnTransitions;
+	}
+
+	// y = weights x + biases for the whole tile, ReLU unless it is the output
+	void dense(const Layer &layer, float (*x)[MAX_NEURONS], float (*y)[MAX_NEURONS], bool last) const
+	{
+		float sums[TILE];
+		if (mode == precision::INT8)
+		{
+			alignas(32) short q[TILE][MAX_NEURONS];
+			float scale[TILE];
+			for (int k = 0; k < TILE; k++)
+				scale[k] = quantize(x[k], layer.stride, q[k]);
+			for (int o = 0; o < layer.outputs; o++)
+			{
+				int products[TILE];
+				dot(&layer.qrows[o * layer.stride], q, layer.stride, products);
+				for (int k = 0; k < TILE; k++)
+					y[k][o] = products[k] * layer.scales[o] * scale[k] + layer.biases[o];
+			}
+		}
+		else
+			for (int o = 0; o < layer.outputs; o++)
+			{
+				dot(&layer.rows[o * layer.stride], x, layer.stride, sums);
+				for (int k = 0; k < TILE; k++)
+					y[k][o] = sums[k] + layer.biases[o];
+			}
+		for (int k = 0; k < TILE; k++)
+			activate(y[k], layer.outputs, round16(layer.outputs), last);
+	}
+
+	// ReLU and zeros up to the padding
+	static void activate(float *y, int outputs, int padded, bool last)
+	{
+		if (!last)
+			for (int o = 0; o < outputs; o++)
+				y[o] = y[o] > 0.0f ? y[o] : 0.0f;
+		for (int o = outputs; o < padded; o++)
+			y[o] = 0.0f;
+	}
+
+	// to int16 with the largest value at 32767, returns the scale back
+	static float quantize(const float *x, int n, short *q)
+	{
+		float largest = 0.0f, scale, inverse;
+		for (int i = 0; i < n; i++)
+			largest = fabsf(x[i]) > largest ? fabsf(x[i]) : largest;
+		scale = largest > 0.0f ? largest / 32767.0f : 1.0f;
+		inverse = 1.0f / scale;
+		for (int i = 0; i < n; i++)
+			q[i] = (short)(x[i] >= 0.0f ? (int)(x[i] * inverse + 0.5f) : -(int)(-x[i] * inverse + 0.5f));
+		return scale;
+	}
+
+	// the column of the lowest bit set
+	static int lowest(unsigned int row)
+	{
+		unsigned int below = (row & (0u - row)) - 1;
+		below = below - ((below >> 1) & 0x155);
+		below = (below & 0x333) + ((below >> 2) & 0x333);
+		return (int)((below + (below >> 4) + (below >> 8)) & 0xF);
+	}
+
+	// n is a multiple of 16 everywhere below
+#if defined(__AVX2__)
+	static void add(float *y, const float *w, int n)
+	{
+		for (int i = 0; i < n; i += 8)
+			_mm256_storeu_ps(y + i, _mm256_add_ps(_mm256_loadu_ps(y + i), _mm256_loadu_ps(w + i)));
+	}
+
+	static void add(short *y, const short *w, int n)
+	{
+		for (int i = 0; i < n; i += 16)
+			_mm256_storeu_si256((__m256i *)(y + i), _mm256_add_epi16(_mm256_loadu_si256((const __m256i *)(y + i)), _mm256_loadu_si256((const __m256i *)(w + i))));
+	}
+
+	static void dot(const float *w, float (*x)[MAX_NEURONS], int n, float *out)
+	{
+		__m256 sums[TILE];
+		for (int k = 0; k < TILE; k++)
+			sums[k] = _mm256_setzero_ps();
+		for (int i = 0; i < n; i += 8)
+		{
+			__m256 weights = _mm256_loadu_ps(w + i);
+			for (int k = 0; k < TILE; k++)
+				sums[k] = _mm256_add_ps(sums[k], _mm256_mul_ps(weights, _mm256_load_ps(&x[k][i])));
+		}
+		for (int k = 0; k < TILE; k++)
+		{
+			__m128 s = _mm_add_ps(_mm256_castps256_ps128(sums[k]), _mm256_extractf128_ps(sums[k], 1));
+			s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+			out[k] = _mm_cvtss_f32(_mm_add_ss(s, _mm_shuffle_ps(s, s, 1)));
+		}
+	}
+
+	static void dot(const short *w, short (*x)[MAX_NEURONS], int n, int *out)
+	{
+		__m256i sums[TILE];
+		for (int k = 0; k < TILE; k++)
+			sums[k] = _mm256_setzero_si256();
+		for (int i = 0; i < n; i += 16)
+		{
+			__m256i weights = _mm256_loadu_si256((const __m256i *)(w + i));
+			for (int k = 0; k < TILE; k++)
+				sums[k] = _mm256_add_epi32(sums[k], _mm256_madd_epi16(weights, _mm256_load_si256((const __m256i *)&x[k][i])));
+		}
+		for (int k = 0; k < TILE; k++)
+		{
+			__m128i s = _mm_add_epi32(_mm256_castsi256_si128(sums[k]), _mm256_extracti128_si256(sums[k], 1));
+			s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4E));
+			out[k] = _mm_cvtsi128_si32(_mm_add_epi32(s, _mm_shuffle_epi32(s, 0xB1)));
+		}
+	}
+#elif defined(EVALUATOR_SSE2)
+	static void add(float *y, const float *w, int n)
+	{
+		for (int i = 0; i < n; i += 4)
+			_mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), _mm_loadu_ps(w + i)));
+	}
+
+	static void add(short *y, const short *w, int n)
+	{
+		for (int i = 0; i < n; i += 8)
+			_mm_storeu_si128((__m128i *)(y + i), _mm_add_epi16(_mm_loadu_si128((const __m128i *)(y + i)), _mm_loadu_si128((const __m128i *)(w + i))));
+	}
+
+	static void dot(const float *w, float (*x)[MAX_NEURONS], int n, float *out)
+	{
+		__m128 sums[TILE];
+		for (int k = 0; k < TILE; k++)
+			sums[k] = _mm_setzero_ps();
+		for (int i = 0; i < n; i += 4)
+		{
+			__m128 weights = _mm_loadu_ps(w + i);
+			for (int k = 0; k < TILE; k++)
+				sums[k] = _mm_add_ps(sums[k], _mm_mul_ps(weights, _mm_load_ps(&x[k][i])));
+		}
+		for (int k = 0; k < TILE; k++)
+		{
+			__m128 s = _mm_add_ps(sums[k], _mm_movehl_ps(sums[k], sums[k]));
+			out[k] = _mm_cvtss_f32(_mm_add_ss(s, _mm_shuffle_ps(s, s, 1)));
+		}
+	}
+
+	static void dot(const short *w, short (*x)[MAX_NEURONS], int n, int *out)
+	{
+		__m128i sums[TILE];
+		for (int k = 0; k < TILE; k++)
+			sums[k] = _mm_setzero_si128();
+		for (int i = 0; i < n; i += 8)
+		{
+			__m128i weights = _mm_loadu_si128((const __m128i *)(w + i));
+			for (int k = 0; k < TILE; k++)
+				sums[k] = _mm_add_epi32(sums[k], _mm_madd_epi16(weights, _mm_load_si128((const __m128i *)&x[k][i])));
+		}
+		for (int k = 0; k < TILE; k++)
+		{
+			__m128i s = _mm_add_epi32(sums[k], _mm_shuffle_epi32(sums[k], 0x4E));
+			out[k] = _mm_cvtsi128_si32(_mm_add_epi32(s, _mm_shuffle_epi32(s, 0xB1)));
+		}
+	}
+#else
+	static void add(float *y, const float *w, int n)
+	{
+		for (int i = 0; i < n; i++)
+			y[i] += w[i];
+	}
+
+	static void add(short *y, const short *w, int n)
+	{
+		for (int i = 0; i < n; i++)
+			y[i] = (short)(y[i] + w[i]);
+	}
+
+	static void dot(const float *w, float (*x)[MAX_NEURONS], int n, float *out)
+	{
+		for (int k = 0; k < TILE; k++)
+		{
+			out[k] = 0.0f;
+			for (int i = 0; i < n; i++)
+				out[k] += w[i] * x[k][i];
+		}
+	}
+
+	static void dot(const short *w, short (*x)[MAX_NEURONS], int n, int *out)
+	{
+		for (int k = 0; k < TILE; k++)
+		{
+			out[k] = 0;
+			for (int i = 0; i < n; i++)
+				out[k] += w[i] * x[k][i];
+		}
+	}
+#endif
+
+	int layers;
+	inputs kind;
+	precision mode;
+	Layer net[MAX_LAYERS];
+};
+
+#endif // !__network_h
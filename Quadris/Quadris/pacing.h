@@ -0,0 +1,168 @@
+#ifndef __pacing_h
+#define __pacing_h
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <mmsystem.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "winmm.lib")
+#endif
+#endif
+
+// decides when the next frame starts, wait() goes at the top of the render loop before the input is read
+// VSYNC: as it always was, input is read right after a swap and the finished frame then waits for vblank in glfwSwapBuffers
+// LOW_LATENCY: still vsync, but the frame sleeps until what its work is predicted to take (the slowest of the last
+// HISTORY frames plus a margin) just fits before the next vblank, then reads input, simulates and renders;
+// a frame that still misses its vblank widens the margin, frames on time slowly narrow it again
+// UNCAPPED: no vsync, a frame is presented as soon as it is done and may tear
+// the cap (frames per second, 0 for none) holds any mode back to at most that rate
+class FramePacer
+{
+public:
+	enum class mode { VSYNC, LOW_LATENCY, UNCAPPED };
+
+	static const int HISTORY = 32;
+	static constexpr double MIN_MARGIN = 0.001, MAX_MARGIN = 0.004;		// seconds
+	static constexpr double SPIN = 0.002;			// the end of a wait is spun, sleeps are not that precise
+
+	FramePacer()
+	{
+		current = mode::VSYNC;
+		cap = 0;
+		period = 1.0 / 60.0;
+		margin = MIN_MARGIN;
+		frames = 0;
+		missed = 0;
+		swappedOnce = false;
+		for (int i = 0; i < HISTORY; i++)
+			work[i] = 0.0;
+		start = lastSwap = clock::now();
+#ifdef _WIN32
+		timeBeginPeriod(1);
+#endif
+	}
+
+	~FramePacer()
+	{
+#ifdef _WIN32
+		timeEndPeriod(1);
+#endif
+	}
+
+	// with the GL context current, refresh in Hz (the monitor's, 60 when unknown)
+	void set(mode m, int fpsCap, int refresh)
+	{
+		current = m;
+		cap = fpsCap > 0 ? fpsCap : 0;
+		period = 1.0 / (refresh > 0 ? refresh : 60);
+		margin = MIN_MARGIN;
+		swappedOnce = false;
+		glfwSwapInterval(m == mode::UNCAPPED ? 0 : 1);
+	}
+
+	// for a loop that presents nothing (the main thread of --render-thread): exactly hz frames a second, vsync left alone
+	void tick(int hz)
+	{
+		current = mode::UNCAPPED;
+		cap = hz;
+	}
+
+	mode getMode() const
+	{
+		return current;
+	}
+
+	int getCap() const
+	{
+		return cap;
+	}
+
+	void wait()
+	{
+		clock::time_point target = clock::now();
+		if (current == mode::LOW_LATENCY && swappedOnce)
+			target = std::max(target, lastSwap + seconds(period - predicted() - margin));
+		if (cap > 0)
+			target = std::max(target, start + seconds(1.0 / cap));
+		sleepUntil(target);
+		// a capped frame that started on time is counted from when it was due, so the rate does not drift
+		clock::time_point now = clock::now();
+		start = cap > 0 && now - target < seconds(1.0 / cap) ? target : now;
+	}
+
+	// right before glfwSwapBuffers, the work of the frame is over
+	void submitting()
+	{
+		work[frames++ % HISTORY] = std::chrono::duration<double>(clock::now() - start).count();
+	}
+
+	// right after glfwSwapBuffers
+	void swapped()
+	{
+		// the driver may queue the frame and return at once, then the return is not the vblank the next wait counts from
+		if (current == mode::LOW_LATENCY)
+			glFinish();
+		clock::time_point now = clock::now();
+		if (current == mode::LOW_LATENCY && swappedOnce)
+		{
+			if (std::chrono::duration<double>(now - lastSwap).count() > 1.5 * period)
+			{
+				margin = margin + 0.0005 < MAX_MARGIN ? margin + 0.0005 : MAX_MARGIN;
+				missed++;
+			}
+			else
+				margin = margin - 0.00002 > MIN_MARGIN ? margin - 0.00002 : MIN_MARGIN;
+		}
+		lastSwap = now;
+		swappedOnce = true;
+	}
+
+	// seconds the work of a frame is expected to take
+	double predicted() const
+	{
+		int n = (int)std::min<long long>(frames, HISTORY);
+		double slowest = 0.0;
+		for (int i = 0; i < n; i++)
+			slowest = std::max(slowest, work[i]);
+		return slowest;
+	}
+
+	long long missed;				// LOW_LATENCY frames that did not make their vblank
+
+private:
+	typedef std::chrono::steady_clock clock;
+
+	static clock::duration seconds(double s)
+	{
+		return std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(s));
+	}
+
+	static void sleepUntil(clock::time_point target)
+	{
+		clock::time_point now = clock::now();
+		if (target - now > seconds(SPIN))
+			std::this_thread::sleep_until(target - seconds(SPIN));
+		while (clock::now() < target)
+			std::this_thread::yield();
+	}
+
+	mode current;
+	int cap;
+	double period, margin;
+	double work[HISTORY];
+	long long frames;
+	bool swappedOnce;
+	clock::time_point start, lastSwap;
+};
+
+#endif // !__pacing_h
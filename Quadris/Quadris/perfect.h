@@ -0,0 +1,380 @@
+#ifndef __perfect_h
+#define __perfect_h
+
+#include "game.h"
+#include "movegen.h"
+#include "zobrist.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+// perfect clear: places the pieces of a known sequence so that the bottom lines are cleared and nothing is left
+// a depth first search over the placements of MoveGenerator, made and unmade on one Bitboard per thread
+// only placements under the lines still to clear are tried, and a board is dropped as soon as its empty cells
+// can not take the pieces left:
+//   count    = four empty cells per piece, and no more pieces than the sequence has
+//   walls    = a column full up to the top splits the board, every part needs four cells per piece
+//   parity   = empty cells of even columns minus odd columns, only I, L, J and T change it
+// line clears move lines down but never change a column, so all three hold through the clears
+// boards without a solution go to a TranspositionTable keyed by the zobrist, the piece index and the problem (the pieces,
+// where they start and the lines to clear), shared by the threads,
+// and the first placements are spread over the threads, the first solution found stops everyone
+class PerfectClear
+{
+public:
+	static const int MAX_PIECES = 16;
+	static const int MAX_HEIGHT = 6;
+
+	// a piece of the sequence and where Grid::start puts it
+	struct Queued
+	{
+		Piece::types type;
+		Cells start;
+	};
+
+	struct Solution
+	{
+		int pieces;
+		Cells cells[MAX_PIECES];		// where each piece of the sequence goes, in order
+	};
+
+	long long nodes;		// boards made by the last solve
+	bool stopped;			// the last solve ran out of nodes before it knew
+
+	// threads <= 0 uses every core
+	PerfectClear(int threads = 0, int bits = 20)
+	{
+		if (threads <= 0)
+			threads = (int)std::thread::hardware_concurrency();
+		if (threads <= 0)
+			threads = 1;
+		for (int i = 0; i < threads; i++)
+			workers.push_back(new Worker());
+		root = new MoveGenerator();
+		table = new TranspositionTable(bits);
+		nodes = 0;
+		stopped = false;
+	}
+
+	~PerfectClear()
+	{
+		for (unsigned int i = 0; i < workers.size(); i++)
+			delete workers[i];
+		delete root;
+		delete table;
+	}
+
+	int threads()
+	{
+		return (int)workers.size();
+	}
+
+	// the board of game and its pieces from the falling one on, the falling piece where it is now
+	// returns how many pieces, out must hold Game::PREVIEW + 1
+	static int fromGame(Game *game, Bitboard *board, Queued *out)
+	{
+		game->g->getBoard(board->rows);
+		board->hash = game->g->getBoardHash();
+		out[0].type = game->g->getType();
+		game->g->getPiece(out[0].start.x, out[0].start.y);
+		for (int i = 1; i <= Game::PREVIEW; i++)
+		{
+			out[i].type = game->queue[i]->type;
+			game->g->getStart(game->queue[i]->type, game->queue[i]->getRotation(), out[i].start.x, out[i].start.y);
+		}
+		return Game::PREVIEW + 1;
+	}
+
+	// clears the lines under height with the first count pieces of queue, or some of them
+	// maxNodes > 0 gives up after about that many boards, stopped tells it apart from a board without solution
+	bool solve(const Bitboard &board, const Queued *q, int count, int height, long long maxNodes, Solution *out)
+	{
+		Cells start = q[0].start;
+		nodes = 0;
+		stopped = false;
+		if (count > MAX_PIECES)
+			count = MAX_PIECES;
+		if (count < 1 || height < 1 || height > MAX_HEIGHT)
+			return false;
+		for (int l = height; l < Bitboard::LINES; l++)
+			if (board.rows[l] != 0)
+				return false;
+		queue = q;
+		size = count;
+		limit = maxNodes;
+		if (!possible(board, 0, height) || !board.spawn(&start))
+			return false;
+		lower(&start, height);
+		if (root->generate(board, start, q[0].type) == 0)
+			return false;
+
+		table->newSearch();
+		problem = problemKey(q, count, height);
+		found = false;
+		exhausted = false;
+		next = 0;
+		spent = 0;
+		std::vector<std::thread> pool;
+		for (unsigned int i = 1; i < workers.size(); i++)
+			pool.push_back(std::thread(&PerfectClear::search, this, workers[i], &board, height));
+		search(workers[0], &board, height);
+		for (unsigned int i = 0; i < pool.size(); i++)
+			pool[i].join();
+		for (unsigned int i = 0; i < workers.size(); i++)
+			nodes += workers[i]->nodes;
+		stopped = !found && exhausted;
+		if (found)
+			*out = solution;
+		return found;
+	}
+
+private:
+	enum class result { FAILED, SOLVED, STOPPED };
+
+	// what one thread needs, allocated once
+	struct Worker
+	{
+		MoveGenerator generator;
+		Bitboard board;
+		UndoStack undo;
+		Cells moves[MAX_PIECES][MoveGenerator::MAX_PLACEMENTS];		// placements of each level, the generator is reused below
+		Cells path[MAX_PIECES];
+		int solved;
+		long long nodes;
+	};
+
+	// every thread takes first placements until none is left
+	void search(Worker *w, const Bitboard *start, int height)
+	{
+		int i;
+		w->nodes = 0;
+		while (!found && (i = next++) < root->count)
+		{
+			const Cells &c = root->placements[i].cells;
+			if (!below(c, height))
+				continue;
+			w->board = *start;
+			Undo *u = w->undo.push();
+			int lines = w->board.make(c, 0, u);
+			w->path[0] = c;
+			w->nodes++;
+			if (deeper(w, 1, height - lines) == result::SOLVED)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (!found)
+				{
+					solution.pieces = w->solved;
+					memcpy(solution.cells, w->path, w->solved * sizeof(Cells));
+					found = true;
+				}
+			}
+			w->board.unmake(w->undo.pop());
+		}
+	}
+
+	// the board of w with index pieces placed and height lines still to clear
+	result deeper(Worker *w, int index, int height)
+	{
+		TranspositionTable::Result r;
+		unsigned long long key;
+		int n = 0;
+		if (height == 0)
+		{
+			w->solved = index;
+			return result::SOLVED;
+		}
+		if ((w->nodes & 1023) == 0 && limit > 0 && (spent += 1024) > limit)
+			exhausted = true;
+		if (found || exhausted)
+			return result::STOPPED;
+		if (index >= size || !possible(w->board, index, height))
+			return result::FAILED;
+		// the lines left follow from the pieces placed, the index is enough
+		key = w->board.hash ^ Zobrist::keys().queue[index % Zobrist::QUEUE] ^ problem;
+		if (table->probe(key, &r) && r.current)
+			return result::FAILED;
+
+		Cells start = queue[index].start;
+		if (!w->board.spawn(&start))
+			return result::FAILED;
+		lower(&start, height);
+		w->generator.generate(w->board, start, queue[index].type);
+		for (int i = 0; i < w->generator.count; i++)
+			if (below(w->generator.placements[i].cells, height))
+				w->moves[index][n++] = w->generator.placements[i].cells;
+
+		for (int i = 0; i < n; i++)
+		{
+			Undo *u = w->undo.push();
+			int lines = w->board.make(w->moves[index][i], 0, u);
+			w->path[index] = w->moves[index][i];
+			w->nodes++;
+			result down = deeper(w, index + 1, height - lines);
+			w->board.unmake(w->undo.pop());
+			if (down != result::FAILED)
+				return down;
+		}
+		table->store(key, 0.0f, size - index);
+		return result::FAILED;
+	}
+
+	// over the lines to clear there is only air, where moving and rotating do the same at any height,
+	// so the search starts the piece just over them instead of at the top: the same placements with a much smaller BFS
+	// MoveGenerator from the real start gives the inputs of a solution
+	static void lower(Cells *c, int height)
+	{
+		int minX = c->x[0], d;
+		for (int i = 1; i < 4; i++)
+			minX = c->x[i] < minX ? c->x[i] : minX;
+		d = minX - (height + 4);
+		if (d > 0)
+			for (int i = 0; i < 4; i++)
+				c->x[i] -= d;
+	}
+
+	static bool below(const Cells &c, int height)
+	{
+		for (int i = 0; i < 4; i++)
+			if (c.x[i] >= height)
+				return false;
+		return true;
+	}
+
+	// whether the pieces from index on can still fill the empty cells under height
+	bool possible(const Bitboard &b, int index, int height) const
+	{
+		unsigned int walls = 0x3FF;
+		int empty = 0, balance = 0, needed, spread = 0;
+		bool odd = false;
+		for (int l = 0; l < height; l++)
+		{
+			unsigned int free = ~b.rows[l] & 0x3FF;
+			walls &= b.rows[l];
+			empty += popcount(free);
+			balance += popcount(free & 0x155) - popcount(free & 0x2AA);
+		}
+		if (empty % 4 != 0)
+			return false;
+		needed = empty / 4;
+		if (index + needed > size)
+			return false;
+
+		for (int c = 0; c < 10;)
+		{
+			unsigned int part = 0;
+			int cells = 0;
+			for (; c < 10 && ((walls >> c) & 1); c++)
+				;
+			for (; c < 10 && !((walls >> c) & 1); c++)
+				part |= 1u << c;
+			for (int l = 0; l < height && part != 0; l++)
+				cells += popcount(~b.rows[l] & part);
+			if (cells % 4 != 0)
+				return false;
+		}
+
+		// O, S, Z, a lying I and a lying T take as many even as odd columns, L, J and a standing T two more of one kind,
+		// a standing I four more
+		for (int i = index; i < index + needed; i++)
+			switch (queue[i].type)
+			{
+			case Piece::types::I:
+				spread += 4;
+				break;
+			case Piece::types::L:
+			case Piece::types::J:
+			case Piece::types::T:
+				spread += 2;
+				odd = true;
+				break;
+			default:
+				break;
+			}
+		return abs(balance) <= spread && (odd || balance % 4 == 0);
+	}
+
+	// a failure only holds for the pieces that were left, a board met again in another solve has others
+	// each piece is rotated by its place so the same piece twice does not cancel out
+	static unsigned long long problemKey(const Queued *q, int count, int height)
+	{
+		const Zobrist &z = Zobrist::keys();
+		unsigned long long h = z.queue[Zobrist::QUEUE - 1 - height];
+		for (int i = 0; i < count; i++)
+		{
+			unsigned long long k = z.piece[(int)q[i].type];
+			for (int j = 0; j < 4; j++)
+				k ^= z.cell[q[i].start.x[j]][q[i].start.y[j]];
+			h ^= (k << (i + 1)) | (k >> (63 - i));
+		}
+		return h;
+	}
+
+	static int popcount(unsigned int v)
+	{
+		v = v - ((v >> 1) & 0x55555555);
+		v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
+		return (int)((((v + (v >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24);
+	}
+
+	MoveGenerator *root;
+	TranspositionTable *table;
+	std::vector<Worker*> workers;		// workers[0] is the calling thread
+
+	// the solve running, read by every thread
+	const Queued *queue;
+	unsigned long long problem;
+	int size;
+	long long limit;
+	std::atomic<int> next;
+	std::atomic<long long> spent;
+	std::atomic<bool> found, exhausted;
+	std::mutex mutex;
+	Solution solution;
+};
+
+// Quadris.exe --pc [positions] [pieces] [height] [max nodes] [threads]
+// perfect clears of the openings of seeded games: the empty board and the first pieces the game deals
+inline int benchmarkPerfectClear(int positions, int pieces, int height, long long maxNodes, int threads)
+{
+	PerfectClear solver(threads);
+	PerfectClear::Queued queue[PerfectClear::MAX_PIECES];
+	PerfectClear::Solution solution;
+	long long nodes = 0;
+	int solved = 0, stopped = 0;
+	if (pieces > PerfectClear::MAX_PIECES)
+		pieces = PerfectClear::MAX_PIECES;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int n = 0; n < positions; n++)
+	{
+		Game game(nullptr, 0x9C000000ULL + n);
+		Bitboard board;
+		PerfectClear::fromGame(&game, &board, queue);
+		// the game deals the pieces after the preview the same way
+		for (int i = Game::PREVIEW + 1; i < pieces; i++)
+		{
+			PiecePtr p = game.newPiece();
+			queue[i].type = p->type;
+			game.g->getStart(p->type, p->getRotation(), queue[i].start.x, queue[i].start.y);
+		}
+		std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
+		bool ok = solver.solve(board, queue, pieces, height, maxNodes, &solution);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count();
+		printf("position %d: %s, %lld boards in %.3f s\n", n, ok ? "solved" : (solver.stopped ? "gave up" : "no solution"), solver.nodes, seconds);
+		solved += ok;
+		stopped += solver.stopped;
+		nodes += solver.nodes;
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	printf("%d pieces, %d lines, %d threads: %d of %d solved, %d gave up, %.3f s, %.2f solutions/s, %.0f boards/s\n", pieces, height, solver.threads(),
+		solved, positions, stopped, seconds, seconds > 0.0 ? solved / seconds : 0.0, seconds > 0.0 ? nodes / seconds : 0.0);
+	return 0;
+}
+
+#endif // !__perfect_h
@@ -8,28 +8,52 @@ class PiecePtr;
 class Piece
 {
 	friend class Grid;
+	friend class BoardBatch;
+	friend class BoardWall;
 
 public:
 	enum class types { L, J, I, O, S, Z, T };
 	enum class rotation { R0, R90, R180, R270 };
 	types type;
 
+	// headless piece, no texture (bots, replays, snapshots)
+	Piece(types t, rotation r)
+	{
+		rot = r;
+		type = t;
+		count_ = 0;
+		texture = 0;
+		model = glm::mat4(1.0f);
+		setGeoForm();
+	}
+
 	Piece(Shader s, types t, rotation r)
 	{
 		rot = r;
 		type = t;
 		count_ = 0;
 
+		setGeoForm();
+		texture = loadTexture();
+
+		s.setInt("text1", 0);
+	}
+
+	// every piece shares the same texture, it is only read from disk once
+	static unsigned int loadTexture()
+	{
+		static unsigned int loaded = 0;
+		if (loaded != 0)
+			return loaded;
+
 		// load image, create texture and generate mipmaps
 		int width, height, nrChannels;
 		unsigned char *data;
-		
-		setGeoForm(s);
 
 		// load and create a texture 
 		// -------------------------
-		glGenTextures(1, &texture);
-		glBindTexture(GL_TEXTURE_2D, texture);
+		glGenTextures(1, &loaded);
+		glBindTexture(GL_TEXTURE_2D, loaded);
 		// set the texture wrapping parameters
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -49,10 +73,10 @@ public:
 		}
 		stbi_image_free(data);
 
-		s.setInt("text1", 0);
+		return loaded;
 	}
 
-	void setGeoForm(Shader s)
+	void setGeoForm()
 	{
 		switch (type)
 		{
@@ -61,53 +85,83 @@ public:
 			positions[1] = glm::vec3(0.0f, -0.5f, 0.0f);
 			positions[2] = glm::vec3(-1.0f, -0.5f, 0.0f);
 			positions[3] = glm::vec3(1.0f, 0.5f, 0.0f);
-			color = glm::vec3(1.0f, 0.647f, 0.0f);
 			break;
 		case Piece::types::J:
 			positions[0] = glm::vec3(1.0f, -0.5f, 0.0f);
 			positions[1] = glm::vec3(0.0f, -0.5f, 0.0f);
 			positions[2] = glm::vec3(-1.0f, -0.5f, 0.0f);
 			positions[3] = glm::vec3(-1.0f, 0.5f, 0.0f);
-			color = glm::vec3(0.0f, 0.0f, 1.0f);
 			break;
 		case Piece::types::I:
 			positions[0] = glm::vec3(0.0f, 1.5f, 0.0f);
 			positions[1] = glm::vec3(0.0f, 0.5f, 0.0f);
 			positions[2] = glm::vec3(0.0f, -0.5f, 0.0f);
 			positions[3] = glm::vec3(0.0f, -1.5f, 0.0f);
-			color = glm::vec3(0.0f, 1.0f, 1.0f);
 			break;
 		case Piece::types::O:
 			positions[0] = glm::vec3(0.5f, 0.5f, 0.0f);
 			positions[1] = glm::vec3(0.5f, -0.5f, 0.0f);
 			positions[2] = glm::vec3(-0.5f, -0.5f, 0.0f);
 			positions[3] = glm::vec3(-0.5f, 0.5f, 0.0f);
-			color = glm::vec3(1.0f, 1.0f, 0.0f);
 			break;
 		case Piece::types::S:
 			positions[0] = glm::vec3(0.0f, 0.5f, 0.0f);
 			positions[1] = glm::vec3(0.0f, -0.5f, 0.0f);
 			positions[2] = glm::vec3(1.0f, 0.5f, 0.0f);
 			positions[3] = glm::vec3(-1.0f, -0.5f, 0.0f);
-			color = glm::vec3(0.0f, 1.0f, 0.0f);
 			break;
 		case Piece::types::Z:
 			positions[0] = glm::vec3(0.0f, 0.5f, 0.0f);
 			positions[1] = glm::vec3(0.0f, -0.5f, 0.0f);
 			positions[2] = glm::vec3(1.0f, -0.5f, 0.0f);
 			positions[3] = glm::vec3(-1.0f, 0.5f, 0.0f);
-			color = glm::vec3(1.0f, 0.0f, 0.0f);
 			break;
 		case Piece::types::T:
 			positions[0] = glm::vec3(0.0f, 0.5f, 0.0f);
 			positions[1] = glm::vec3(0.0f, -0.5f, 0.0f);
 			positions[2] = glm::vec3(1.0f, -0.5f, 0.0f);
 			positions[3] = glm::vec3(-1.0f, -0.5f, 0.0f);
-			color = glm::vec3(0.627f, 0.125f, 0.941f);
 			break;
 		default:
 			break;
 		}
+		color = colorOf(type);
+	}
+
+	static glm::vec3 colorOf(types t)
+	{
+		switch (t)
+		{
+		case Piece::types::L:
+			return glm::vec3(1.0f, 0.647f, 0.0f);
+		case Piece::types::J:
+			return glm::vec3(0.0f, 0.0f, 1.0f);
+		case Piece::types::I:
+			return glm::vec3(0.0f, 1.0f, 1.0f);
+		case Piece::types::O:
+			return glm::vec3(1.0f, 1.0f, 0.0f);
+		case Piece::types::S:
+			return glm::vec3(0.0f, 1.0f, 0.0f);
+		case Piece::types::Z:
+			return glm::vec3(1.0f, 0.0f, 0.0f);
+		case Piece::types::T:
+			return glm::vec3(0.627f, 0.125f, 0.941f);
+		default:
+			return glm::vec3(0.0f, 0.0f, 0.0f);
+		}
+	}
+
+	rotation getRotation()
+	{
+		return rot;
+	}
+
+	// turns a piece into another one, see Game::next
+	void reset(types t, rotation r)
+	{
+		rot = r;
+		type = t;
+		setGeoForm();
 	}
 
 	void setModel(glm::mat4 m)
@@ -168,6 +222,7 @@ public:
 	PiecePtr(Piece* p) : p_(p) { ++p_->count_; }  // p must not be null
 	~PiecePtr() { if (--p_->count_ == 0) delete p_; }
 	PiecePtr(const PiecePtr& p) : p_(p.p_) { ++p_->count_; }
+	bool unique() const { return p_->count_ == 1; }
 	PiecePtr& operator= (const PiecePtr& p)
 	{ // DO NOT CHANGE THE ORDER OF THESE STATEMENTS!
 	  // (This order properly handles self-assignment)
@@ -0,0 +1,110 @@
+#ifndef __player_h
+#define __player_h
+
+#include "game.h"
+#include "replay.h"
+
+// plays a replay back into its own Game, drawn with the same Game::draw as a live game
+// seeking restores the closest keyframe and re-simulates at most KEYFRAME_INTERVAL ms of events
+class ReplayPlayer
+{
+public:
+	static const int MAX_SPEED = 0;				// as fast as the events can be simulated
+	static const int EVENTS_PER_STEP = 20000;	// at MAX_SPEED, events simulated per advance
+
+	Game *game;
+	int speed;
+	bool playing;
+
+	ReplayPlayer(Shader *s, Replay *r)
+	{
+		shader = s;
+		replay = r;
+		reader = nullptr;
+		speed = 1;
+		playing = true;
+		game = new Game(shader, replay->seed, replay->level);
+		game->snapshot(&start);
+		seek(0);
+	}
+
+	~ReplayPlayer()
+	{
+		delete reader;
+		delete game;
+	}
+
+	unsigned int length()
+	{
+		return replay->getLastTick();
+	}
+
+	double position()
+	{
+		return now;
+	}
+
+	bool finished()
+	{
+		return !pending && reader->position() >= replay->data.size();
+	}
+
+	void seek(double tick)
+	{
+		const Replay::Keyframe *k = replay->keyframeBefore((unsigned int)tick);
+		delete reader;
+		if (k != nullptr)
+		{
+			game->restore(k->state);
+			reader = new Replay::Reader(replay, k);
+		}
+		else
+		{
+			game->restore(start);
+			reader = new Replay::Reader(replay);
+		}
+		now = tick;
+		pending = false;
+		runUntil(tick, -1);
+	}
+
+	// seconds of wall time since the last call
+	void advance(double seconds)
+	{
+		if (!playing || finished())
+			return;
+		if (speed == MAX_SPEED)
+		{
+			runUntil(length(), EVENTS_PER_STEP);
+			now = pending ? event.tick : length();
+			return;
+		}
+		now += seconds * 1000.0 * speed;
+		runUntil(now, -1);
+	}
+
+private:
+	// limit < 0 means no limit
+	void runUntil(double tick, int limit)
+	{
+		for (int n = 0; limit < 0 || n < limit; n++)
+		{
+			if (!pending && !(pending = reader->next(&event)))
+				return;
+			if (event.tick > tick)
+				return;
+			game->execute(event.a, event.count);
+			pending = false;
+		}
+	}
+
+	Shader *shader;
+	Replay *replay;
+	Replay::Reader *reader;
+	Replay::Event event;
+	Snapshot start;
+	bool pending;
+	double now;
+};
+
+#endif // !__player_h
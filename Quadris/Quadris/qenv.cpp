@@ -0,0 +1,50 @@
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <stb_image.h>
+#include <shader_s.h>
+#include "vecenv.h"
+#include "qenv.h"
+
+static_assert(QENV_LINES == VectorEnv::LINES && QENV_COLUMNS == VectorEnv::COLUMNS, "board size");
+static_assert(QENV_QUEUE == VectorEnv::QUEUE && QENV_MAX_PLACEMENTS == VectorEnv::MAX_PLACEMENTS, "queue and placements");
+static_assert(QENV_HARD_DROP == (int)Replay::action::HARD_DROP && QENV_NONE == VectorEnv::NONE, "frame actions");
+static_assert(sizeof(qenv_buffers) == sizeof(VectorEnv::Buffers), "buffers");
+
+// qenv is never defined, the pointers are VectorEnv
+static VectorEnv *cast(qenv *env)
+{
+	return reinterpret_cast<VectorEnv *>(env);
+}
+
+qenv *qenv_create(int games, int mode, int threads, int gravity)
+{
+	return reinterpret_cast<qenv *>(new VectorEnv(games, mode == QENV_PLACEMENT ? VectorEnv::mode::PLACEMENT : VectorEnv::mode::FRAME, threads, gravity));
+}
+
+void qenv_destroy(qenv *env)
+{
+	delete cast(env);
+}
+
+int qenv_games(qenv *env)
+{
+	return cast(env)->size();
+}
+
+void qenv_set_buffers(qenv *env, const qenv_buffers *b)
+{
+	VectorEnv::Buffers buffers = { b->board, b->piece, b->queue, b->reward, b->done, b->placement_count, b->placements };
+	cast(env)->setBuffers(buffers);
+}
+
+void qenv_reset(qenv *env, const unsigned long long *seeds)
+{
+	cast(env)->reset(seeds);
+}
+
+void qenv_step(qenv *env, const int *actions)
+{
+	cast(env)->step(actions);
+}
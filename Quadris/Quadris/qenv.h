@@ -0,0 +1,76 @@
+#ifndef __qenv_h
+#define __qenv_h
+
+/* C interface to VectorEnv, for training agents from other languages (ctypes, cffi, ...)
+ * built as QuadrisEnv.dll by the QuadrisEnv project, or elsewhere with
+ *   g++ -O2 -shared -fPIC -DQENV_EXPORTS -I../../Include qenv.cpp glad.c stb_image.cpp -lglfw -o libqenv.so
+ * every buffer belongs to the caller and is written in place by qenv_reset and qenv_step, see VectorEnv::Buffers */
+
+#ifdef _WIN32
+#ifdef QENV_EXPORTS
+#define QENV_API __declspec(dllexport)
+#else
+#define QENV_API __declspec(dllimport)
+#endif
+#else
+#define QENV_API __attribute__((visibility("default")))
+#endif
+
+#define QENV_LINES 24
+#define QENV_COLUMNS 10
+#define QENV_QUEUE 7
+#define QENV_MAX_PLACEMENTS 512
+
+/* modes */
+#define QENV_FRAME 0
+#define QENV_PLACEMENT 1
+
+/* frame actions */
+#define QENV_LEFT 0
+#define QENV_RIGHT 1
+#define QENV_ROTATE_CW 2
+#define QENV_ROTATE_CCW 3
+#define QENV_FALL 4
+#define QENV_LOCK 5
+#define QENV_HARD_DROP 6
+#define QENV_NONE 7
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct qenv qenv;
+
+/* any of them may be null, per game:
+ * board      QENV_LINES * QENV_COLUMNS bytes, line 0 first, 1 filled, the falling piece not included
+ * piece      9 bytes: the type (L J I O S Z T), then line and column of the four blocks
+ * queue      QENV_QUEUE bytes: the types, the falling piece first
+ * reward     points scored by the step
+ * done       1 when the step lost the game, the observation is already the one of the next game
+ * placements QENV_MAX_PLACEMENTS * 8 bytes, line and column of the four blocks of each placement, placement mode */
+typedef struct qenv_buffers
+{
+	unsigned char *board;
+	unsigned char *piece;
+	unsigned char *queue;
+	float *reward;
+	unsigned char *done;
+	int *placement_count;
+	unsigned char *placements;
+} qenv_buffers;
+
+/* threads <= 0 uses every core; gravity: a fall every that many frames, 0 never (frame mode) */
+QENV_API qenv *qenv_create(int games, int mode, int threads, int gravity);
+QENV_API void qenv_destroy(qenv *env);
+QENV_API int qenv_games(qenv *env);
+QENV_API void qenv_set_buffers(qenv *env, const qenv_buffers *buffers);
+/* seeds: one per game, or null for random ones */
+QENV_API void qenv_reset(qenv *env, const unsigned long long *seeds);
+/* actions: one per game, a frame action or the index of a placement of the last observation */
+QENV_API void qenv_step(qenv *env, const int *actions);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !__qenv_h */
@@ -0,0 +1,40 @@
+#ifndef __random_h
+#define __random_h
+
+#include <random>
+
+// splitmix64: tiny state so it fits in a snapshot and the same seed gives the same pieces
+// used like std::random_device, random() % 7
+class Random
+{
+public:
+	typedef unsigned int result_type;
+
+	Random()
+	{
+		std::random_device rd;
+		seed(((unsigned long long)rd() << 32) | rd());
+	}
+
+	Random(unsigned long long s)
+	{
+		seed(s);
+	}
+
+	void seed(unsigned long long s)
+	{
+		state = s;
+	}
+
+	unsigned int operator()()
+	{
+		unsigned long long z = (state += 0x9E3779B97F4A7C15ULL);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		return (unsigned int)((z ^ (z >> 31)) >> 32);
+	}
+
+	unsigned long long state;
+};
+
+#endif // !__random_h
@@ -0,0 +1,239 @@
+#ifndef __render_h
+#define __render_h
+
+#include "imgui.h"
+#include "batch.h"
+#include "game.h"
+#include "mailbox.h"
+#include "snapshot.h"
+#include "trace.h"
+#include "wall.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+// everything the render thread needs to draw one frame, filled by the main thread
+// the ImGui draw lists are copied into buffers each slot keeps, so after the first frames nothing is allocated
+struct RenderFrame
+{
+	static const int BOARDS = 2;
+
+	long long number;
+	int width, height;				// framebuffer, only the main thread may ask GLFW for it
+	int boards;						// one for the single player game, more go through BoardBatch at places
+	Snapshot states[BOARDS];		// the games on screen: board, falling piece, shadow and queue
+	glm::mat4 places[BOARDS];
+	bool hint;						// only with one board
+	int hintX[4], hintY[4];
+	int wallBoards;					// or the spectator wall, resized only when it grows
+	std::vector<WallTile> wall;
+
+	RenderFrame()
+	{
+		number = 0;
+		width = height = 0;
+		boards = 0;
+		hint = false;
+		wallBoards = 0;
+		count = vertices = indices = 0;
+	}
+
+	~RenderFrame()
+	{
+		for (int i = 0; i < lists.Size; i++)
+			IM_DELETE(lists[i]);
+	}
+
+	RenderFrame(const RenderFrame &) = delete;
+	RenderFrame &operator=(const RenderFrame &) = delete;
+
+	// right after ImGui::Render
+	void capture(const ImDrawData *d)
+	{
+		count = d != nullptr && d->Valid ? d->CmdListsCount : 0;
+		while (lists.Size < count)
+			lists.push_back(IM_NEW(ImDrawList)(nullptr));
+		for (int i = 0; i < count; i++)
+		{
+			copy(&lists[i]->CmdBuffer, d->CmdLists[i]->CmdBuffer);
+			copy(&lists[i]->IdxBuffer, d->CmdLists[i]->IdxBuffer);
+			copy(&lists[i]->VtxBuffer, d->CmdLists[i]->VtxBuffer);
+		}
+		vertices = count > 0 ? d->TotalVtxCount : 0;
+		indices = count > 0 ? d->TotalIdxCount : 0;
+		displayPos = count > 0 ? d->DisplayPos : ImVec2(0.0f, 0.0f);
+		displaySize = count > 0 ? d->DisplaySize : ImVec2(0.0f, 0.0f);
+	}
+
+	// the copy as ImDrawData, the lists stay owned by the frame
+	void ui(ImDrawData *d)
+	{
+		d->Valid = true;
+		d->CmdLists = lists.Data;
+		d->CmdListsCount = count;
+		d->TotalVtxCount = vertices;
+		d->TotalIdxCount = indices;
+		d->DisplayPos = displayPos;
+		d->DisplaySize = displaySize;
+	}
+
+private:
+	// ImVector's operator= frees and allocates again, resize keeps what the vector already has
+	template <typename T>
+	static void copy(ImVector<T> *to, const ImVector<T> &from)
+	{
+		to->resize(from.Size);
+		if (from.Size > 0)
+			memcpy(to->Data, from.Data, (size_t)from.Size * sizeof(T));
+	}
+
+	ImVector<ImDrawList *> lists;
+	int count, vertices, indices;
+	ImVec2 displayPos, displaySize;
+};
+
+// Quadris.exe --render-thread [mode]: the GL context moves to a thread that only draws
+// the main thread keeps GLFW events, input, the simulation and the ImGui widgets at a fixed tick rate and publishes
+// a RenderFrame every tick through a Mailbox (a lock-free triple buffer), so neither side ever waits for the other:
+// a slow swap no longer holds back gravity or input, and the render thread skips the frames it was too slow for
+// ImGui_ImplOpenGL3_RenderDrawData still reads io.DisplayFramebufferScale, the main thread writes the same value there every tick
+class RenderThread
+{
+public:
+	// times of a frame around glfwSwapBuffers (glfwGetTime), sent back for InputLatency
+	struct Presented
+	{
+		long long frame;
+		double submitted, swapped;
+	};
+
+	std::atomic<int> swapInterval;			// picked up by the render thread before its next frame
+	std::atomic<double> wallSeconds;		// what the last BoardWall::draw took on the render thread
+
+	// the context must be current on no thread, shader, vertexArray, b and bw were made in it
+	RenderThread(GLFWwindow *w, Shader s, unsigned int vertexArray, BoardBatch *b, BoardWall *bw, int interval) : shader(s)
+	{
+		window = w;
+		vao = vertexArray;
+		batch = b;
+		wall = bw;
+		swapInterval = interval;
+		wallSeconds = 0.0;
+		published = 0;
+		quit = false;
+		worker = std::thread(&RenderThread::run, this);
+	}
+
+	~RenderThread()
+	{
+		quit = true;
+		worker.join();
+	}
+
+	// main thread: fill frame(), then publish() it; returns the number the frame was given
+	RenderFrame &frame()
+	{
+		return frames.slot();
+	}
+
+	long long publish()
+	{
+		long long number = ++published;
+		frames.slot().number = number;
+		frames.publish();
+		return number;
+	}
+
+	// main thread: the newest frame that came back from glfwSwapBuffers since the last call
+	bool presented(Presented *p)
+	{
+		return swaps.take(p);
+	}
+
+private:
+	void run()
+	{
+		Trace::get().nameThread("render");
+		glfwMakeContextCurrent(window);
+		int interval = swapInterval;
+		glfwSwapInterval(interval);
+		{
+			// the board drawn is a copy of the one on the main thread, with textures made in this context
+			Game view(&shader, 0);
+			while (!quit)
+			{
+				if (swapInterval != interval)
+				{
+					interval = swapInterval;
+					glfwSwapInterval(interval);
+				}
+				RenderFrame *f = frames.latest();
+				if (f == nullptr)
+				{
+					std::this_thread::sleep_for(std::chrono::microseconds(500));
+					continue;
+				}
+				TRACE_ZONE("render frame");
+				draw(f, &view);
+				Presented &p = swaps.slot();
+				p.frame = f->number;
+				p.submitted = glfwGetTime();
+				{
+					TRACE_ZONE("glfwSwapBuffers");
+					glfwSwapBuffers(window);
+				}
+				p.swapped = glfwGetTime();
+				swaps.publish();
+			}
+		}
+		glfwMakeContextCurrent(NULL);
+	}
+
+	// the same as the serial loop: clear, boards, hint or the wall, then ImGui on top
+	void draw(RenderFrame *f, Game *view)
+	{
+		glViewport(0, 0, f->width, f->height);
+		glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		if (f->boards == 1)
+		{
+			view->show(f->states[0]);
+			glBindVertexArray(vao);
+			view->draw(shader);
+			if (f->hint)
+				view->g->drawHint(shader, f->hintX, f->hintY);
+		}
+		else if (f->boards > 1)
+		{
+			batch->begin();
+			for (int i = 0; i < f->boards; i++)
+				batch->add(f->states[i], f->places[i]);
+			batch->draw();
+		}
+		else if (f->wallBoards > 0)
+		{
+			double started = glfwGetTime();
+			wall->draw(f->wall.data(), f->wallBoards, f->width, f->height);
+			wallSeconds = glfwGetTime() - started;
+		}
+		ImDrawData data;
+		f->ui(&data);
+		ImGui_ImplOpenGL3_RenderDrawData(&data);
+	}
+
+	GLFWwindow *window;
+	Shader shader;
+	unsigned int vao;
+	BoardBatch *batch;
+	BoardWall *wall;
+	long long published;					// main thread only
+	Mailbox<RenderFrame> frames;
+	Mailbox<Presented> swaps;
+	std::atomic<bool> quit;
+	std::thread worker;
+};
+
+#endif // !__render_h
@@ -0,0 +1,410 @@
+#ifndef __replay_h
+#define __replay_h
+
+#include "snapshot.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+// a whole game as its seed plus every input that changed the board
+// each event is one varint: (milliseconds since the previous event << 3) | action
+// a run of gravity steps with nothing in between is one FALL event followed by a varint with the run length - 1,
+// at most MAX_FALLS: after as many steps as the grid has lines the piece has landed and the rest change nothing
+// EXTENDED is followed by one byte for the rare events (soft drop on/off, level change)
+// every KEYFRAME_INTERVAL ms of play a full snapshot is kept, they go after the events with an index footer
+// so a seek restores the closest keyframe and only re-simulates what comes after it
+class Replay
+{
+public:
+	enum class action { LEFT, RIGHT, ROTATE_CW, ROTATE_CCW, FALL, LOCK, HARD_DROP, EXTENDED };
+	enum extended { SOFT_DROP_ON = 0x10, SOFT_DROP_OFF = 0x11, LEVEL = 0x20 };	// LEVEL + n sets level n
+	static const unsigned char VERSION = 3;
+	static const unsigned int KEYFRAME_INTERVAL = 30000;
+	static const unsigned int MAX_FALLS = Snapshot::GRID_LINES;
+
+	struct Event
+	{
+		unsigned int tick;			// milliseconds of play since the game started
+		action a;
+		unsigned int count;			// FALL: how many steps, EXTENDED: the extended code
+	};
+
+	struct Keyframe
+	{
+		unsigned int tick;			// tick of the last event before it
+		unsigned int offset;		// bytes of events already applied
+		Snapshot state;
+	};
+
+	unsigned long long seed, timestamp;
+	int level;
+	int points;					// what the game claimed at the end, checked by the verifier
+	char name[64];
+	std::vector<unsigned char> data;
+	std::vector<Keyframe> keyframes;
+
+	Replay()
+	{
+		begin(0, 0, 0);
+	}
+
+	void begin(unsigned long long sd, int l, unsigned long long ts)
+	{
+		seed = sd;
+		level = l;
+		timestamp = ts;
+		points = 0;
+		name[0] = '\0';
+		data.clear();
+		data.reserve(1 << 16);
+		keyframes.clear();
+		keyframes.reserve(64);			// half an hour of play, a lock does not have to grow it
+		lastTick = pendingTick = 0;
+		pendingFalls = 0;
+	}
+
+	void setName(const char *n)
+	{
+		strncpy(name, n, 63);
+		name[63] = '\0';
+	}
+
+	// only touches a preallocated buffer, gravity steps are just counted
+	void record(action a, unsigned int tick)
+	{
+		if (a == action::FALL)
+		{
+			if (pendingFalls == 0)
+				pendingTick = tick;
+			if (pendingFalls < MAX_FALLS)
+				pendingFalls++;
+			return;
+		}
+		flush();
+		putEvent(a, tick);
+	}
+
+	void recordExtended(unsigned char code, unsigned int tick)
+	{
+		flush();
+		putEvent(action::EXTENDED, tick);
+		data.push_back(code);
+	}
+
+	void flush()
+	{
+		if (pendingFalls == 0)
+			return;
+		putEvent(action::FALL, pendingTick);
+		putVarint(pendingFalls - 1);
+		pendingFalls = 0;
+	}
+
+	bool needsKeyframe(unsigned int tick)
+	{
+		unsigned int last = keyframes.empty() ? 0 : keyframes.back().tick;
+		return tick - last >= KEYFRAME_INTERVAL;
+	}
+
+	// s must be the state after every event recorded so far
+	void addKeyframe(const Snapshot &s)
+	{
+		flush();
+		Keyframe k;
+		k.tick = lastTick;
+		k.offset = (unsigned int)data.size();
+		k.state = s;
+		keyframes.push_back(k);
+	}
+
+	// last keyframe at or before tick, nullptr if the game has to be replayed from the start
+	const Keyframe* keyframeBefore(unsigned int tick)
+	{
+		int first = 0, last = (int)keyframes.size() - 1, found = -1;
+		while (first <= last)
+		{
+			int middle = (first + last) / 2;
+			if (keyframes[middle].tick <= tick)
+			{
+				found = middle;
+				first = middle + 1;
+			}
+			else
+				last = middle - 1;
+		}
+		return found >= 0 ? &keyframes[found] : nullptr;
+	}
+
+	unsigned int getLastTick()
+	{
+		return pendingFalls > 0 && pendingTick > lastTick ? pendingTick : lastTick;
+	}
+
+	// header: "QRPL", version, level, seed, timestamp, name length, name, then the events
+	// footer: the keyframes (tick, offset, snapshot), keyframe count, events size, final points, "QKEY"
+	bool save(const char *path)
+	{
+		TRACE_ZONE("Replay::save");
+		flush();
+		std::vector<unsigned char> header, footer;
+		header.insert(header.end(), { 'Q', 'R', 'P', 'L', VERSION, (unsigned char)level });
+		putFixed(&header, seed);
+		putFixed(&header, timestamp);
+		header.push_back((unsigned char)strlen(name));
+		header.insert(header.end(), name, name + strlen(name));
+		for (unsigned int i = 0; i < keyframes.size(); i++)
+		{
+			putFixed(&footer, keyframes[i].tick, 4);
+			putFixed(&footer, keyframes[i].offset, 4);
+			const unsigned char *state = (const unsigned char *)&keyframes[i].state;
+			footer.insert(footer.end(), state, state + sizeof(Snapshot));
+		}
+		putFixed(&footer, keyframes.size(), 4);
+		putFixed(&footer, data.size(), 4);
+		putFixed(&footer, (unsigned int)points, 4);
+		footer.insert(footer.end(), { 'Q', 'K', 'E', 'Y' });
+
+		FILE *f = fopen(path, "wb");
+		if (f == NULL)
+			return false;
+		bool ok = fwrite(header.data(), 1, header.size(), f) == header.size();
+		if (!data.empty())
+			ok = ok && fwrite(data.data(), 1, data.size(), f) == data.size();
+		ok = ok && fwrite(footer.data(), 1, footer.size(), f) == footer.size();
+		fclose(f);
+		return ok;
+	}
+
+	bool load(const char *path)
+	{
+		TRACE_ZONE("Replay::load");
+		FILE *f = fopen(path, "rb");
+		if (f == NULL)
+			return false;
+		std::vector<unsigned char> file;
+		unsigned char chunk[4096];
+		size_t n;
+		while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+			file.insert(file.end(), chunk, chunk + n);
+		fclose(f);
+		return parse(file);
+	}
+
+	bool parse(const std::vector<unsigned char> &file)
+	{
+		if (file.size() < 23 || memcmp(file.data(), "QRPL", 4) != 0 || file[4] != VERSION)
+			return false;
+		size_t pos = 6, end = file.size();
+		begin(getFixed(file, &pos), file[5], 0);
+		timestamp = getFixed(file, &pos);
+		size_t length = file[pos++];
+		if (length > 63 || pos + length > file.size())
+			return false;
+		memcpy(name, &file[pos], length);
+		name[length] = '\0';
+		pos += length;
+		// the counts are checked against what is left before they are multiplied, size_t is 32 bits on Win32
+		size_t tail = 16, keyframe = 8 + sizeof(Snapshot);
+		size_t at = end - tail, count, size;
+		if (end < pos + tail || memcmp(&file[end - 4], "QKEY", 4) != 0)
+			return false;
+		count = (size_t)getFixed(file, &at, 4);
+		size = (size_t)getFixed(file, &at, 4);
+		points = (int)getFixed(file, &at, 4);
+		if (count > (end - pos - tail) / keyframe || size != end - pos - tail - count * keyframe)
+			return false;
+		at = pos + size;
+		for (size_t i = 0; i < count; i++)
+		{
+			Keyframe k;
+			k.tick = (unsigned int)getFixed(file, &at, 4);
+			k.offset = (unsigned int)getFixed(file, &at, 4);
+			memcpy(&k.state, &file[at], sizeof(Snapshot));
+			at += sizeof(Snapshot);
+			if (!k.state.valid() || k.offset > size)
+				return false;
+			keyframes.push_back(k);
+		}
+		end = pos + size;
+		data.assign(file.begin() + pos, file.begin() + end);
+		lastTick = 0;
+		Reader r(this);
+		Event e;
+		while (r.next(&e))
+			lastTick = e.tick;
+		return r.ok();
+	}
+
+	class Reader
+	{
+	public:
+		Reader(Replay *r)
+		{
+			replay = r;
+			pos = 0;
+			tick = 0;
+			error = false;
+		}
+
+		// starts right after a keyframe
+		Reader(Replay *r, const Keyframe *k)
+		{
+			replay = r;
+			pos = k->offset;
+			tick = k->tick;
+			error = false;
+		}
+
+		bool next(Event *e)
+		{
+			unsigned long long word;
+			if (pos >= replay->data.size() || !getVarint(&word))
+				return false;
+			tick += (unsigned int)(word >> 3);
+			e->tick = tick;
+			e->a = (action)(word & 7);
+			e->count = 1;
+			if (e->a == action::FALL)
+			{
+				if (!getVarint(&word))
+					return false;
+				// a longer run is not something the game records, it would only make the verifier spin
+				if (word >= MAX_FALLS)
+				{
+					error = true;
+					return false;
+				}
+				e->count = (unsigned int)word + 1;
+			}
+			else if (e->a == action::EXTENDED)
+			{
+				if (pos >= replay->data.size())
+				{
+					error = true;
+					return false;
+				}
+				e->count = replay->data[pos++];
+			}
+			return true;
+		}
+
+		bool ok()
+		{
+			return !error;
+		}
+
+		size_t position()
+		{
+			return pos;
+		}
+
+	private:
+		bool getVarint(unsigned long long *value)
+		{
+			int shift = 0;
+			*value = 0;
+			while (pos < replay->data.size() && shift < 64)
+			{
+				unsigned char byte = replay->data[pos++];
+				*value |= (unsigned long long)(byte & 0x7F) << shift;
+				if ((byte & 0x80) == 0)
+					return true;
+				shift += 7;
+			}
+			error = true;
+			return false;
+		}
+
+		Replay *replay;
+		size_t pos;
+		unsigned int tick;
+		bool error;
+	};
+
+private:
+	void putEvent(action a, unsigned int tick)
+	{
+		if (tick < lastTick)
+			tick = lastTick;
+		putVarint(((unsigned long long)(tick - lastTick) << 3) | (unsigned long long)a);
+		lastTick = tick;
+	}
+
+	void putVarint(unsigned long long value)
+	{
+		while (value >= 0x80)
+		{
+			data.push_back((unsigned char)(value | 0x80));
+			value >>= 7;
+		}
+		data.push_back((unsigned char)value);
+	}
+
+	static void putFixed(std::vector<unsigned char> *out, unsigned long long value, int bytes = 8)
+	{
+		for (int i = 0; i < bytes; i++)
+			out->push_back((unsigned char)(value >> (8 * i)));
+	}
+
+	static unsigned long long getFixed(const std::vector<unsigned char> &in, size_t *pos, int bytes = 8)
+	{
+		unsigned long long value = 0;
+		for (int i = 0; i < bytes; i++)
+			value |= (unsigned long long)in[(*pos)++] << (8 * i);
+		return value;
+	}
+
+	unsigned int lastTick, pendingTick, pendingFalls;
+};
+
+inline void makeDirectory(const char *path)
+{
+#ifdef _WIN32
+	_mkdir(path);
+#else
+	mkdir(path, 0755);
+#endif
+}
+
+// file names (not paths) of every replay in dir, oldest first
+inline void listReplays(const char *dir, std::vector<std::string> *files)
+{
+	files->clear();
+#ifdef _WIN32
+	WIN32_FIND_DATAA entry;
+	std::string pattern = std::string(dir) + "/*.qrp";
+	HANDLE find = FindFirstFileA(pattern.c_str(), &entry);
+	if (find == INVALID_HANDLE_VALUE)
+		return;
+	do
+		files->push_back(entry.cFileName);
+	while (FindNextFileA(find, &entry));
+	FindClose(find);
+#else
+	DIR *d = opendir(dir);
+	struct dirent *entry;
+	if (d == NULL)
+		return;
+	while ((entry = readdir(d)) != NULL)
+	{
+		std::string name = entry->d_name;
+		if (name.size() > 4 && name.compare(name.size() - 4, 4, ".qrp") == 0)
+			files->push_back(name);
+	}
+	closedir(d);
+#endif
+	std::sort(files->begin(), files->end());
+}
+
+#endif // !__replay_h
@@ -0,0 +1,217 @@
+#ifndef __scores_h
+#define __scores_h
+
+#include "trace.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <vector>
+
+// one line of scores.sco: "name;points;level;timestamp"
+// old files only have "name;points", those records get level -1 and timestamp 0
+// and only show up in the all-time ranking with every level
+struct ScoreRecord
+{
+	char name[64];
+	int points;
+	int level;
+	long long timestamp;
+
+	ScoreRecord()
+	{
+		name[0] = '\0';
+		points = 0;
+		level = -1;
+		timestamp = 0;
+	}
+
+	ScoreRecord(const char *n, int p, int l, long long t)
+	{
+		strncpy(name, n, 63);
+		name[63] = '\0';
+		points = p;
+		level = l;
+		timestamp = t;
+	}
+
+	long long day()
+	{
+		return timestamp / 86400;
+	}
+};
+
+class Leaderboard
+{
+public:
+	enum class window { DAILY, WEEKLY, ALL_TIME };
+	static const int LEVELS = 6;				// ESCOLHAS slider goes from 0 to 5
+	static const int ALL_LEVELS = LEVELS;		// extra ranking slot merging every level
+	static const int DAYS = 7;					// ring of daily buckets, one week long
+
+	Leaderboard()
+	{
+		for (int d = 0; d < DAYS; d++)
+			buckets[d].day = -1;
+		viewWindow = window::ALL_TIME;
+		viewLevel = ALL_LEVELS;
+		dirty = true;
+	}
+
+	void load(const char *path)
+	{
+		TRACE_ZONE("Leaderboard::load");
+		std::ifstream sf;
+		char line[128];
+		sf.open(path, std::ifstream::in);
+		while (sf.getline(line, 128))
+		{
+			ScoreRecord r;
+			if (parse(line, &r))
+				insert(r, std::time(nullptr));
+		}
+		sf.close();
+	}
+
+	void save(const char *path, ScoreRecord r)
+	{
+		TRACE_ZONE("Leaderboard::save");
+		std::ofstream sf;
+		sf.open(path, std::fstream::app);
+		sf << r.name << ";" << r.points << ";" << r.level << ";" << r.timestamp << std::endl;
+		sf.close();
+		insert(r, std::time(nullptr));
+	}
+
+	// incremental: the record goes in sorted position of the all-time list and of its day bucket,
+	// a bucket that still holds an older day is recycled in place (that is the whole expiry)
+	void insert(ScoreRecord r, long long now)
+	{
+		int index = (int)records.size();
+		records.push_back(r);
+
+		insertSorted(&allTime[ALL_LEVELS], index);
+		if (r.level >= 0 && r.level < LEVELS)
+			insertSorted(&allTime[r.level], index);
+
+		long long today = now / 86400;
+		long long day = records[index].day();
+		if (r.timestamp > 0 && day <= today && day > today - DAYS)
+		{
+			Bucket *bucket = &buckets[day % DAYS];
+			if (bucket->day != day)
+				recycle(bucket, day);
+			insertSorted(&bucket->ranking[ALL_LEVELS], index);
+			if (r.level >= 0 && r.level < LEVELS)
+				insertSorted(&bucket->ranking[r.level], index);
+		}
+		dirty = true;
+	}
+
+	// indices into records, best first; only rebuilt when the view or the data changed
+	const std::vector<int>& view(window w, int level, long long now)
+	{
+		long long today = now / 86400;
+		if (!dirty && w == viewWindow && level == viewLevel && today == viewDay)
+			return current;
+
+		viewWindow = w;
+		viewLevel = level;
+		viewDay = today;
+		dirty = false;
+		current.clear();
+		switch (w)
+		{
+		case window::DAILY:
+			if (buckets[today % DAYS].day == today)
+				current = buckets[today % DAYS].ranking[level];
+			break;
+		case window::WEEKLY:
+			for (int d = 0; d < DAYS; d++)
+			{
+				Bucket *bucket = &buckets[d];
+				if (bucket->day <= today - DAYS || bucket->day > today)
+					continue;
+				size_t middle = current.size();
+				current.insert(current.end(), bucket->ranking[level].begin(), bucket->ranking[level].end());
+				std::inplace_merge(current.begin(), current.begin() + middle, current.end(), Better(&records));
+			}
+			break;
+		case window::ALL_TIME:
+			current = allTime[level];
+			break;
+		default:
+			break;
+		}
+		return current;
+	}
+
+	ScoreRecord& at(int index)
+	{
+		return records[index];
+	}
+
+	static bool parse(char *line, ScoreRecord *r)
+	{
+		int index;
+		char *field;
+		for (index = 0; line[index] != '\0' && line[index] != ';'; index++);
+		if (index < 2 || line[index] != ';')
+			return false;
+		line[index] = '\0';
+		field = &line[index + 1];
+		*r = ScoreRecord(line, atoi(field), -1, 0);
+		field = strchr(field, ';');
+		if (field != nullptr)
+		{
+			r->level = atoi(++field);
+			field = strchr(field, ';');
+			if (field != nullptr)
+				r->timestamp = atoll(++field);
+		}
+		return true;
+	}
+
+private:
+	struct Bucket
+	{
+		long long day;
+		std::vector<int> ranking[LEVELS + 1];
+	};
+
+	struct Better
+	{
+		std::vector<ScoreRecord> *r;
+
+		Better(std::vector<ScoreRecord> *records) : r(records) {}
+
+		bool operator()(int i, int j)
+		{
+			return (*r)[i].points > (*r)[j].points;
+		}
+	};
+
+	void insertSorted(std::vector<int> *ranking, int index)
+	{
+		ranking->insert(std::upper_bound(ranking->begin(), ranking->end(), index, Better(&records)), index);
+	}
+
+	void recycle(Bucket *bucket, long long day)
+	{
+		bucket->day = day;
+		for (int l = 0; l <= LEVELS; l++)
+			bucket->ranking[l].clear();
+	}
+
+	std::vector<ScoreRecord> records;
+	std::vector<int> allTime[LEVELS + 1], current;
+	Bucket buckets[DAYS];
+	window viewWindow;
+	int viewLevel;
+	long long viewDay;
+	bool dirty;
+};
+
+#endif // !__scores_h
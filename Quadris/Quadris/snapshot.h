@@ -0,0 +1,200 @@
+#ifndef __snapshot_h
+#define __snapshot_h
+
+#include "trace.h"
+
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// everything needed to put a game back exactly where it was, written as is to disk
+// cells are packed two per byte: 0 is empty, 1 + Piece::types for a piece, GARBAGE for a garbage line of the versus mode
+struct Snapshot
+{
+	static const unsigned int VERSION = 1;
+	static const int LINES = 24, COLUMNS = 10;
+	static const int GARBAGE = 8;
+	static const int GRID_LINES = 28;			// lines of Grid, a piece can be above the ones kept here
+
+	char magic[4];
+	unsigned int version;
+	unsigned int size;
+	unsigned char cells[LINES * COLUMNS / 2];
+	unsigned char piece[4][2], shadow[4][2];		// line, column of each block
+	unsigned char queue[7][2];						// type, rotation; queue[0] is the falling piece
+	unsigned char bag[7], bagSize;
+	unsigned char level, lost, assisted;
+	int points;
+	unsigned long long seed, rngType, rngRotation;
+	char name[64];
+
+	Snapshot()
+	{
+		memset(this, 0, sizeof(Snapshot));
+		memcpy(magic, "QSNP", 4);
+		version = VERSION;
+		size = sizeof(Snapshot);
+	}
+
+	// the file comes from the disk or from a replay of anyone, Game::restore indexes with what is checked here
+	bool valid() const
+	{
+		if (memcmp(magic, "QSNP", 4) != 0 || version != VERSION || size != sizeof(Snapshot))
+			return false;
+		if (bagSize < 1 || bagSize > 7)
+			return false;
+		for (int i = 0; i < bagSize; i++)
+			if (bag[i] >= 7)
+				return false;
+		for (int i = 0; i < 7; i++)
+			if (queue[i][0] >= 7 || queue[i][1] >= 4)
+				return false;
+		for (int i = 0; i < 4; i++)
+			if (piece[i][0] >= GRID_LINES || piece[i][1] >= COLUMNS || shadow[i][0] >= GRID_LINES || shadow[i][1] >= COLUMNS)
+				return false;
+		for (int l = 0; l < LINES; l++)
+			for (int c = 0; c < COLUMNS; c++)
+				if (getCell(l, c) > GARBAGE)
+					return false;
+		return true;
+	}
+
+	int getCell(int l, int c) const
+	{
+		int i = l * COLUMNS + c;
+		return (cells[i >> 1] >> ((i & 1) * 4)) & 0xF;
+	}
+
+	void setCell(int l, int c, int kind)
+	{
+		int i = l * COLUMNS + c;
+		cells[i >> 1] = (unsigned char)((cells[i >> 1] & ~(0xF << ((i & 1) * 4))) | (kind << ((i & 1) * 4)));
+	}
+};
+
+// maps the file instead of streaming it, resume is a single page fault and a memcpy
+inline bool readSnapshot(const char *path, Snapshot *s)
+{
+	TRACE_ZONE("readSnapshot");
+	bool ok = false;
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	if (GetFileSize(file, NULL) == sizeof(Snapshot))
+	{
+		HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping != NULL)
+		{
+			const void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, sizeof(Snapshot));
+			if (view != NULL)
+			{
+				memcpy(s, view, sizeof(Snapshot));
+				ok = s->valid();
+				UnmapViewOfFile(view);
+			}
+			CloseHandle(mapping);
+		}
+	}
+	CloseHandle(file);
+#else
+	int file = open(path, O_RDONLY);
+	struct stat info;
+	if (file < 0)
+		return false;
+	if (fstat(file, &info) == 0 && info.st_size == sizeof(Snapshot))
+	{
+		void *view = mmap(NULL, sizeof(Snapshot), PROT_READ, MAP_PRIVATE, file, 0);
+		if (view != MAP_FAILED)
+		{
+			memcpy(s, view, sizeof(Snapshot));
+			ok = s->valid();
+			munmap(view, sizeof(Snapshot));
+		}
+	}
+	close(file);
+#endif
+	return ok;
+}
+
+inline void removeSnapshot(const char *path)
+{
+	remove(path);
+}
+
+// puts from in place of to in one step, to is never missing: a crash leaves the old file or the new one
+inline bool replaceFile(const char *from, const char *to)
+{
+#ifdef _WIN32
+	return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	return rename(from, to) == 0;
+#endif
+}
+
+// writes on its own thread so pausing never waits on the disk
+// the copy goes to path.tmp first and is renamed, a crash never leaves half a snapshot
+class SnapshotWriter
+{
+public:
+	SnapshotWriter(const char *p)
+	{
+		strncpy(path, p, 255);
+		path[255] = '\0';
+	}
+
+	~SnapshotWriter()
+	{
+		wait();
+	}
+
+	void write(const Snapshot &s)
+	{
+		wait();
+		pending = s;
+		worker = std::thread(&SnapshotWriter::run, this);
+	}
+
+	void wait()
+	{
+		if (worker.joinable())
+			worker.join();
+	}
+
+private:
+	void run()
+	{
+		Trace::get().nameThread("snapshot writer");
+		TRACE_ZONE("SnapshotWriter::write");
+		char tmp[260];
+		snprintf(tmp, 260, "%s.tmp", path);
+		FILE *f = fopen(tmp, "wb");
+		if (f == NULL)
+			return;
+		bool ok = fwrite(&pending, sizeof(Snapshot), 1, f) == 1;
+		fclose(f);
+		if (ok)
+			replaceFile(tmp, path);
+	}
+
+	char path[256];
+	Snapshot pending;
+	std::thread worker;
+};
+
+#endif // !__snapshot_h
@@ -0,0 +1,209 @@
+#ifndef __spectate_h
+#define __spectate_h
+
+#include "imgui.h"
+#include "bot.h"
+#include "game.h"
+#include "player.h"
+#include "replay.h"
+#include "snapshot.h"
+#include "trace.h"
+#include "wall.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// the spectator wall: up to MAX_BOARDS headless games at once, the saved replays (newest first, looped)
+// and bots for the rest, drawn by one BoardWall with one pass of labels over ImGui
+// a board is read again only when its hash moved, and the bots share a budget of plans per frame,
+// so a frame with many boards costs little more than one with few beyond running the games themselves
+class Spectators
+{
+public:
+	static const int MAX_BOARDS = 256;
+	static const int PLANS_PER_FRAME = 16;		// bots that find no plan this frame keep their piece where it is
+	static constexpr double DELAY = 0.05;		// seconds between two inputs of a bot, slower than BOT_DELAY to be followed
+
+	Spectators() : bot(1, 1)
+	{
+		cursor = 0;
+	}
+
+	~Spectators()
+	{
+		stop();
+	}
+
+	// count boards, the replays found in dir first
+	void start(int count, const char *dir)
+	{
+		TRACE_ZONE("Spectators::start");
+		stop();
+		count = count < 1 ? 1 : (count > MAX_BOARDS ? MAX_BOARDS : count);
+		std::vector<std::string> files;
+		listReplays(dir, &files);
+		for (int i = (int)files.size() - 1; i >= 0 && (int)boards.size() < count / 2; i--)
+		{
+			Board *b = new Board();
+			if (!b->replay.load((std::string(dir) + "/" + files[i]).c_str()))
+			{
+				delete b;
+				continue;
+			}
+			b->player = new ReplayPlayer(nullptr, &b->replay);
+			b->game = b->player->game;
+			snprintf(b->name, 64, "%s", b->replay.name[0] != '\0' ? b->replay.name : "?");
+			boards.push_back(b);
+		}
+		for (int i = 0; (int)boards.size() < count; i++)
+		{
+			Board *b = new Board();
+			b->game = new Game(nullptr, Game::newSeed());
+			snprintf(b->name, 64, "IA %d", i + 1);
+			// the bots do not all ask for a plan on the same frame
+			b->wait = -DELAY * (i % 8) / 8.0;
+			boards.push_back(b);
+		}
+		tiles.assign(boards.size(), WallTile());
+		for (unsigned int i = 0; i < boards.size(); i++)
+			read(i);
+	}
+
+	void stop()
+	{
+		for (unsigned int i = 0; i < boards.size(); i++)
+			delete boards[i];
+		boards.clear();
+		tiles.clear();
+	}
+
+	int count() const
+	{
+		return (int)boards.size();
+	}
+
+	// the boards as BoardWall::draw takes them
+	const WallTile *getTiles() const
+	{
+		return tiles.data();
+	}
+
+	// seconds of wall time since the last call
+	void update(double frameTime)
+	{
+		TRACE_ZONE("Spectators::update");
+		int n = (int)boards.size(), plans = 0;
+		// the bot that got the last plan is not the first to ask next frame
+		for (int k = 0; k < n; k++)
+		{
+			int i = (cursor + k) % n;
+			Board *b = boards[i];
+			if (b->player != nullptr)
+			{
+				if (b->player->finished())
+					b->player->seek(0);
+				b->player->advance(frameTime);
+			}
+			else
+			{
+				if (b->game->g->lost)
+				{
+					delete b->game;
+					b->game = new Game(nullptr, Game::newSeed());
+					b->count = b->next = 0;
+				}
+				b->wait += frameTime;
+				while (b->wait >= DELAY && !b->game->g->lost)
+				{
+					if (b->next == b->count)
+					{
+						if (plans == PLANS_PER_FRAME)
+						{
+							b->wait = DELAY;
+							break;
+						}
+						plans++;
+						cursor = i + 1;
+						b->count = bot.plan(b->game, b->inputs);
+						b->next = 0;
+						if (b->count == 0)
+							break;
+					}
+					b->wait -= DELAY;
+					b->game->apply(b->inputs[b->next++]);
+				}
+			}
+			if (b->game->g->getHash() != b->shown)
+				read(i);
+		}
+	}
+
+	// name and points over every board, in one pass over the overlay draw list; display in pixels
+	void labels(const WallLayout &l, ImVec2 display)
+	{
+		TRACE_ZONE("Spectators::labels");
+		ImFont *font = ImGui::GetFont();
+		float size = l.labelH * display.y * 0.8f;
+		size = size > 20.0f ? 20.0f : size;
+		if (size < 6.0f)
+			return;
+		ImDrawList *list = ImGui::GetOverlayDrawList();
+		for (unsigned int i = 0; i < boards.size(); i++)
+		{
+			ImVec2 at(l.x(i) * display.x, (l.y(i) - l.labelH) * display.y + (l.labelH * display.y - size) / 2.0f);
+			list->AddText(font, size, at, IM_COL32(255, 255, 255, 255), boards[i]->label);
+		}
+	}
+
+private:
+	// one game of the wall, on the heap so the Replay a ReplayPlayer points to never moves
+	struct Board
+	{
+		Game *game;							// the bot's own, or the one of player
+		ReplayPlayer *player;
+		Replay replay;
+		Replay::action inputs[MoveGenerator::MAX_INPUTS];
+		int count, next;					// inputs of the current plan and the next one to apply
+		double wait;
+		unsigned long long shown;			// hash of the game when its tile was made
+		char name[64], label[80];
+
+		Board()
+		{
+			game = nullptr;
+			player = nullptr;
+			count = next = 0;
+			wait = 0.0;
+			shown = 0;
+			name[0] = label[0] = '\0';
+		}
+
+		~Board()
+		{
+			if (player != nullptr)
+				delete player;
+			else
+				delete game;
+		}
+	};
+
+	// the tile and the label of board i from its game
+	void read(int i)
+	{
+		Board *b = boards[i];
+		b->game->snapshot(&scratch);
+		memcpy(tiles[i].cells, scratch.cells, sizeof(tiles[i].cells));
+		tiles[i].next = scratch.queue[1][0];
+		b->shown = b->game->g->getHash();
+		snprintf(b->label, 80, "%s  %d", b->name, (int)b->game->g->getPoints());
+	}
+
+	Bot bot;								// width and depth 1: a plan is a few tens of microseconds
+	std::vector<Board *> boards;
+	std::vector<WallTile> tiles;
+	Snapshot scratch;
+	int cursor;
+};
+
+#endif // !__spectate_h
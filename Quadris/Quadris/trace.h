@@ -0,0 +1,376 @@
+#ifndef __trace_h
+#define __trace_h
+
+#include "allocations.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define TRACE_RDTSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define TRACE_RDTSC
+#endif
+
+// timeline of instrumented zones, written as Chrome trace JSON (chrome://tracing, ui.perfetto.dev)
+// every thread writes its own ring of events without locks, the lock is only taken the first time a thread records
+// a zone is one complete event ("ph": "X") written when it ends: two reads of the time stamp counter and a store,
+// the counter is turned into time when the trace is dumped (steady_clock is read instead off x86)
+// a zone also keeps what the thread allocated while it ran, shown as its args
+// a thread that ends copies its events to one shared ring of the events of finished threads and leaves its buffer
+// to the next thread that records, so threads that come and go cost no more than the ones running at the same time
+// dumpLater hands the file to a thread of the trace, the caller (F9 in the middle of a frame) does not wait for the disk
+class Trace
+{
+public:
+	static const int CAPACITY = 1 << 16;			// events kept per thread and for the finished threads, the oldest are overwritten
+	static const int NAMES = 64;					// names of finished threads kept
+
+	struct Event
+	{
+		const char *name;
+		long long begin, end;				// ticks()
+		long long allocations, bytes;		// operator new calls inside the zone
+	};
+
+	static Trace &get()
+	{
+		static Trace trace;
+		return trace;
+	}
+
+	bool enabled() const
+	{
+		return recording.load(std::memory_order_relaxed);
+	}
+
+	// the writer of dumpLater starts with the first recording, before the frame it could stall
+	void enable(bool on)
+	{
+		if (on && !writer.joinable())
+			writer = std::thread(&Trace::write, this);
+		recording.store(on, std::memory_order_relaxed);
+	}
+
+	static long long ticks()
+	{
+#ifdef TRACE_RDTSC
+		return (long long)__rdtsc();
+#else
+		return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+	}
+
+	void record(const char *name, long long begin, long long end, long long allocations = 0, long long bytes = 0)
+	{
+		Buffer *b = local();
+		unsigned long long h = b->head.load(std::memory_order_relaxed);
+		Event &e = b->events[h & (CAPACITY - 1)];
+		e.name = name;
+		e.begin = begin;
+		e.end = end;
+		e.allocations = allocations;
+		e.bytes = bytes;
+		b->head.store(h + 1, std::memory_order_release);
+	}
+
+	// shown in the trace instead of the thread number, name must stay valid
+	// the buffer of the thread is only made once it records something
+	void nameThread(const char *name)
+	{
+		threadName() = name;
+		if (mine().buffer != nullptr)
+			strncpy(mine().buffer->name, name, sizeof(mine().buffer->name) - 1);
+	}
+
+	// dump on the writer thread and return at once, path must stay valid until it is written
+	void dumpLater(const char *path)
+	{
+		{
+			std::lock_guard<std::mutex> lock(requestMutex);
+			requested = path;
+		}
+		wake.notify_one();
+	}
+
+	// every event still in the buffers and of the threads that ended, a thread writing while this runs may lose its oldest ones
+	// the events are copied under the lock and written after it is released, a thread that records for the first time
+	// waits for the copy, not for the disk
+	bool dump(const char *path)
+	{
+		std::lock_guard<std::mutex> one(writing);
+		std::vector<Name> named;
+		std::vector<Finished> events;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (int i = 0; i < NAMES && i < finishedNames; i++)
+				named.push_back(names[i]);
+			if (!finished.empty())
+				for (unsigned long long k = finishedHead > CAPACITY ? finishedHead - CAPACITY : 0; k < finishedHead; k++)
+					events.push_back(finished[k & (CAPACITY - 1)]);
+			for (unsigned int i = 0; i < buffers.size(); i++)
+			{
+				Buffer *b = buffers[i];
+				unsigned long long h = b->head.load(std::memory_order_acquire);
+				if (b->name[0] != '\0')
+				{
+					Name n;
+					n.tid = b->tid;
+					memcpy(n.name, b->name, sizeof(n.name));
+					named.push_back(n);
+				}
+				for (unsigned long long k = h > CAPACITY ? h - CAPACITY : 0; k < h; k++)
+				{
+					Finished d;
+					d.event = b->events[k & (CAPACITY - 1)];
+					d.tid = b->tid;
+					events.push_back(d);
+				}
+			}
+		}
+
+		FILE *f = fopen(path, "w");
+		if (f == NULL)
+			return false;
+		bool comma = false;
+		// ticks to microseconds, measured over the whole life of the trace
+		long long elapsed = ticks() - start;
+		double scale = elapsed > 0 ? std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - epoch).count() / elapsed : 0.0;
+		fprintf(f, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+		for (unsigned int i = 0; i < named.size(); i++)
+		{
+			fprintf(f, "%s{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"%s\"}}", comma ? ",\n" : "", named[i].tid, named[i].name);
+			comma = true;
+		}
+		for (unsigned int i = 0; i < events.size(); i++)
+		{
+			event(f, events[i].event, events[i].tid, scale, comma);
+			comma = true;
+		}
+		fprintf(f, "\n]}\n");
+		return fclose(f) == 0;
+	}
+
+private:
+	struct Buffer
+	{
+		Event events[CAPACITY];
+		std::atomic<unsigned long long> head;
+		int tid;
+		char name[32];
+	};
+
+	struct Finished
+	{
+		Event event;
+		int tid;
+	};
+
+	struct Name
+	{
+		int tid;
+		char name[32];
+	};
+
+	// the buffer of a thread, given back when the thread ends
+	struct Slot
+	{
+		Buffer *buffer;
+
+		~Slot()
+		{
+			if (buffer != nullptr)
+				Trace::get().finish(buffer);
+		}
+	};
+
+	Trace()
+	{
+		epoch = std::chrono::steady_clock::now();
+		start = ticks();
+		recording = false;
+		threads = 0;
+		finishedHead = 0;
+		finishedNames = 0;
+		requested = nullptr;
+		quit = false;
+	}
+
+	~Trace()
+	{
+		{
+			std::lock_guard<std::mutex> lock(requestMutex);
+			quit = true;
+		}
+		wake.notify_one();
+		if (writer.joinable())
+			writer.join();
+	}
+
+	static Slot &mine()
+	{
+		static thread_local Slot slot = { nullptr };
+		return slot;
+	}
+
+	static const char *&threadName()
+	{
+		static thread_local const char *name = nullptr;
+		return name;
+	}
+
+	Buffer *local()
+	{
+		Buffer *&b = mine().buffer;
+		if (b == nullptr)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			Buffer *made;
+			if (!spare.empty())
+			{
+				made = spare.back();
+				spare.pop_back();
+			}
+			else
+				made = new Buffer();
+			made->head = 0;
+			memset(made->name, 0, sizeof(made->name));
+			if (threadName() != nullptr)
+				strncpy(made->name, threadName(), sizeof(made->name) - 1);
+			made->tid = ++threads;
+			buffers.push_back(made);
+			b = made;
+		}
+		return b;
+	}
+
+	// on a thread that ends: its events and name go with the finished ones, its buffer waits for another thread
+	void finish(Buffer *b)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		unsigned long long h = b->head.load(std::memory_order_acquire);
+		if (finished.empty())
+			finished.resize(CAPACITY);
+		for (unsigned long long k = h > CAPACITY ? h - CAPACITY : 0; k < h; k++)
+		{
+			Finished &d = finished[finishedHead++ & (CAPACITY - 1)];
+			d.event = b->events[k & (CAPACITY - 1)];
+			d.tid = b->tid;
+		}
+		if (b->name[0] != '\0')
+		{
+			Name &n = names[finishedNames++ % NAMES];
+			n.tid = b->tid;
+			memcpy(n.name, b->name, sizeof(n.name));
+		}
+		buffers.erase(std::find(buffers.begin(), buffers.end(), b));
+		spare.push_back(b);
+	}
+
+	void event(FILE *f, const Event &e, int tid, double scale, bool comma)
+	{
+		fprintf(f, "%s{\"ph\": \"X\", \"name\": \"%s\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f", comma ? ",\n" : "", e.name, tid,
+			(e.begin - start) * scale, (e.end - e.begin) * scale);
+		if (e.allocations > 0)
+			fprintf(f, ", \"args\": {\"allocations\": %lld, \"bytes\": %lld}", e.allocations, e.bytes);
+		fprintf(f, "}");
+	}
+
+	// the writer thread of dumpLater
+	void write()
+	{
+		while (true)
+		{
+			const char *path;
+			{
+				std::unique_lock<std::mutex> lock(requestMutex);
+				wake.wait(lock, [this]() { return quit || requested != nullptr; });
+				if (requested == nullptr)
+					return;
+				path = requested;
+				requested = nullptr;
+			}
+			if (!dump(path))
+				printf("could not write %s\n", path);
+		}
+	}
+
+	std::chrono::steady_clock::time_point epoch;
+	long long start;
+	std::atomic<bool> recording;
+	std::mutex mutex;
+	std::vector<Buffer *> buffers;			// of the threads running
+	std::vector<Buffer *> spare;			// of the threads that ended, for the next ones
+	std::vector<Finished> finished;			// ring of the events of the threads that ended
+	unsigned long long finishedHead;
+	Name names[NAMES];
+	int finishedNames, threads;
+
+	std::mutex writing;						// one dump at a time, F9 and the one at exit
+	std::mutex requestMutex;
+	std::condition_variable wake;
+	const char *requested;
+	bool quit;
+	std::thread writer;
+};
+
+// records the scope it is declared in, when the trace is on
+class TraceZone
+{
+public:
+	TraceZone(const char *n)
+	{
+		Trace &t = Trace::get();
+		name = t.enabled() ? n : nullptr;
+		if (name != nullptr)
+		{
+			const AllocationCounter &a = allocations();
+			count = a.count;
+			bytes = a.bytes;
+			begin = Trace::ticks();
+		}
+	}
+
+	~TraceZone()
+	{
+		if (name != nullptr)
+		{
+			long long end = Trace::ticks();
+			const AllocationCounter &a = allocations();
+			Trace::get().record(name, begin, end, a.count - count, a.bytes - bytes);
+		}
+	}
+
+private:
+	const char *name;
+	long long begin, count, bytes;
+};
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#define TRACE_ZONE(name) TraceZone TRACE_CONCAT(traceZone, __LINE__)(name)
+
+// Quadris.exe --trace <file> [any other mode]
+// records from the start and writes the file when the program ends
+inline const char *&tracePath()
+{
+	static const char *path = nullptr;
+	return path;
+}
+
+inline void dumpTraceAtExit()
+{
+	if (tracePath() != nullptr && !Trace::get().dump(tracePath()))
+		printf("could not write %s\n", tracePath());
+}
+
+#endif // !__trace_h
@@ -0,0 +1,376 @@
+#ifndef __tuner_h
+#define __tuner_h
+
+#include "bot.h"
+#include "random.h"
+#include "snapshot.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// genetic algorithm over the evaluator weights
+// every individual plays the same games of a generation (same seeds), so fitness differences come from the weights
+// and not from luckier pieces; the seeds change every generation so nothing overfits to one set of games
+// so the champions of different generations are not comparable: each one is kept as a candidate and the best is
+// only picked at the end, after every candidate played the same final set of games
+// individuals are spread over a pool of threads started once for the whole run, each thread with its own Bot
+// after every generation the whole state goes to the checkpoint, a run started with the same file goes on from there
+class Tuner
+{
+public:
+	static const int GENES = 7;
+	static const int ELITE = 2;
+	static const int TOURNAMENT = 3;
+	static const int VERSION = 2;			// of the checkpoint
+	static const int CANDIDATES = 32;		// champions of the last generations, played again before the best is picked
+
+	struct Individual
+	{
+		float genes[GENES];
+		double fitness;			// lines per game
+	};
+
+	int generation, population, games, maxPieces, width, depth;
+	unsigned long long seed;
+	std::vector<Individual> individuals;
+	std::vector<Individual> candidates;		// the champion of each generation, fitness from that generation's games
+	Individual best;						// the candidate that did best on the final games, after pick()
+
+	Tuner(int p, int g, int pieces, int w, int d)
+	{
+		population = p < ELITE + 1 ? ELITE + 1 : p;
+		games = g < 1 ? 1 : g;
+		maxPieces = pieces;
+		width = w;
+		depth = d;
+		generation = 0;
+		seed = Game::newSeed();
+		random.seed(seed);
+		batch = nullptr;
+		batchSeed = 0;
+		job = 0;
+		pending = 0;
+		quit = false;
+
+		// the hand picked weights and noise around them
+		Individual start;
+		fromWeights(Evaluator::Weights(), start.genes);
+		start.fitness = 0.0;
+		for (int i = 0; i < population; i++)
+		{
+			Individual n = start;
+			if (i > 0)
+				for (int k = 0; k < GENES; k++)
+					n.genes[k] += 0.3f * gaussian();
+			normalize(n.genes);
+			individuals.push_back(n);
+		}
+		best = individuals[0];
+		best.fitness = -1.0;
+	}
+
+	~Tuner()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quit = true;
+		}
+		wake.notify_all();
+		for (unsigned int i = 0; i < pool.size(); i++)
+			pool[i].join();
+	}
+
+	static void fromWeights(const Evaluator::Weights &w, float *genes)
+	{
+		genes[0] = w.height;
+		genes[1] = w.lines;
+		genes[2] = w.holes;
+		genes[3] = w.bumpiness;
+		genes[4] = w.wells;
+		genes[5] = w.rowTransitions;
+		genes[6] = w.columnTransitions;
+	}
+
+	static void toWeights(const float *genes, Evaluator::Weights *w)
+	{
+		w->height = genes[0];
+		w->lines = genes[1];
+		w->holes = genes[2];
+		w->bumpiness = genes[3];
+		w->wells = genes[4];
+		w->rowTransitions = genes[5];
+		w->columnTransitions = genes[6];
+	}
+
+	// plays every individual on the games of this generation, returns the games played per second
+	// threads <= 0 uses every core, only the first call starts the pool
+	double evaluate(int threads)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		run(&individuals, seed ^ ((unsigned long long)(generation + 1) * 0x9E3779B97F4A7C15ULL), threads);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		return seconds > 0.0 ? population * games / seconds : 0.0;
+	}
+
+	// sorts by fitness, keeps the elite and breeds the rest by tournament, blend crossover and mutation
+	void breed()
+	{
+		std::vector<Individual> children;
+		std::sort(individuals.begin(), individuals.end(), [](const Individual &a, const Individual &b) { return a.fitness > b.fitness; });
+		candidates.push_back(individuals[0]);
+		if ((int)candidates.size() > CANDIDATES)
+			candidates.erase(candidates.begin());
+		for (int i = 0; i < ELITE; i++)
+			children.push_back(individuals[i]);
+		while ((int)children.size() < population)
+		{
+			const Individual &a = tournament(), &b = tournament();
+			Individual child;
+			float mix = uniform();
+			for (int k = 0; k < GENES; k++)
+			{
+				child.genes[k] = mix * a.genes[k] + (1.0f - mix) * b.genes[k];
+				if (uniform() < 0.2f)
+					child.genes[k] += 0.2f * gaussian();
+			}
+			normalize(child.genes);
+			child.fitness = 0.0;
+			children.push_back(child);
+		}
+		individuals = children;
+		generation++;
+	}
+
+	// plays every candidate on the same final games and keeps the best of them in best
+	void pick(int threads)
+	{
+		std::vector<Individual> final = candidates;
+		if (final.empty())
+			final.push_back(individuals[0]);
+		run(&final, seed ^ 0xD1B54A32D192ED03ULL, threads);
+		best = *std::max_element(final.begin(), final.end(), [](const Individual &a, const Individual &b) { return a.fitness < b.fitness; });
+	}
+
+	// text, one individual per line, written to a temporary file first so a crash never leaves half a checkpoint
+	bool save(const char *path)
+	{
+		std::string temporary = std::string(path) + ".tmp";
+		FILE *f = fopen(temporary.c_str(), "w");
+		if (f == NULL)
+			return false;
+		fprintf(f, "QTUNE %d\n%d %d %d %d %d %d %llu %llu\n", VERSION, generation, population, games, maxPieces, width, depth, seed, random.state);
+		write(f, best);
+		fprintf(f, "%d\n", (int)candidates.size());
+		for (unsigned int i = 0; i < candidates.size(); i++)
+			write(f, candidates[i]);
+		for (int i = 0; i < population; i++)
+			write(f, individuals[i]);
+		bool ok = fclose(f) == 0;
+		return ok && replaceFile(temporary.c_str(), path);
+	}
+
+	bool load(const char *path)
+	{
+		FILE *f = fopen(path, "r");
+		int version, count = 0;
+		bool ok;
+		if (f == NULL)
+			return false;
+		ok = fscanf(f, "QTUNE %d %d %d %d %d %d %d %llu %llu", &version, &generation, &population, &games, &maxPieces, &width, &depth, &seed, &random.state) == 9
+			&& version == VERSION && population > ELITE && read(f, &best) && fscanf(f, "%d", &count) == 1 && count >= 0 && count <= CANDIDATES;
+		candidates.resize(ok ? count : 0);
+		for (int i = 0; ok && i < count; i++)
+			ok = read(f, &candidates[i]);
+		individuals.resize(ok ? population : 0);
+		for (int i = 0; ok && i < population; i++)
+			ok = read(f, &individuals[i]);
+		fclose(f);
+		return ok;
+	}
+
+private:
+	// every individual of b plays the games of base on the pool
+	void run(std::vector<Individual> *b, unsigned long long base, int threads)
+	{
+		if (pool.empty())
+		{
+			if (threads <= 0)
+				threads = (int)std::thread::hardware_concurrency();
+			if (threads <= 0)
+				threads = 1;
+			for (int t = 0; t < threads; t++)
+				pool.push_back(std::thread(&Tuner::work, this));
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			batch = b;
+			batchSeed = base;
+			next = 0;
+			pending = (int)pool.size();
+			job++;
+		}
+		wake.notify_all();
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [this]() { return pending == 0; });
+	}
+
+	void work()
+	{
+		unsigned int seen = 0;
+		Bot bot(width, depth, 1);
+		Trace::get().nameThread("tuner");
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [&]() { return quit || job != seen; });
+				if (quit)
+					return;
+				seen = job;
+			}
+			int i;
+			while ((i = next++) < (int)batch->size())
+				(*batch)[i].fitness = play(&bot, (*batch)[i].genes, batchSeed);
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (--pending == 0)
+					done.notify_one();
+			}
+		}
+	}
+
+	double play(Bot *bot, const float *genes, unsigned long long base)
+	{
+		Replay::action inputs[MoveGenerator::MAX_INPUTS];
+		long long lines = 0;
+		toWeights(genes, &bot->weights);
+		for (int g = 0; g < games; g++)
+		{
+			// same seeds for every individual of a batch
+			Game game(nullptr, base ^ (unsigned long long)g);
+			for (int pieces = 0; !game.g->lost && pieces < maxPieces; pieces++)
+			{
+				int count = bot->plan(&game, inputs);
+				if (count == 0)
+					break;
+				for (int i = 0; i < count; i++)
+				{
+					game.execute(inputs[i], 1);
+					lines += game.linesCleared;
+				}
+			}
+		}
+		return (double)lines / games;
+	}
+
+	const Individual& tournament()
+	{
+		int winner = (int)(random() % population);
+		for (int i = 1; i < TOURNAMENT; i++)
+		{
+			int other = (int)(random() % population);
+			if (individuals[other].fitness > individuals[winner].fitness)
+				winner = other;
+		}
+		return individuals[winner];
+	}
+
+	// the evaluation is a weighted sum, only the direction of the weights matters
+	static void normalize(float *genes)
+	{
+		float length = 0.0f;
+		for (int k = 0; k < GENES; k++)
+			length += genes[k] * genes[k];
+		length = sqrtf(length);
+		if (length > 0.0f)
+			for (int k = 0; k < GENES; k++)
+				genes[k] /= length;
+	}
+
+	float uniform()
+	{
+		return (random() >> 8) / 16777216.0f;
+	}
+
+	float gaussian()
+	{
+		float u = uniform(), v = uniform();
+		return sqrtf(-2.0f * logf(u > 0.0f ? u : 1e-7f)) * cosf(6.2831853f * v);
+	}
+
+	static void write(FILE *f, const Individual &n)
+	{
+		for (int k = 0; k < GENES; k++)
+			fprintf(f, "%.9g ", n.genes[k]);
+		fprintf(f, "%.9g\n", n.fitness);
+	}
+
+	static bool read(FILE *f, Individual *n)
+	{
+		for (int k = 0; k < GENES; k++)
+			if (fscanf(f, "%g", &n->genes[k]) != 1)
+				return false;
+		return fscanf(f, "%lg", &n->fitness) == 1;
+	}
+
+	Random random;
+	std::vector<Individual> *batch;			// what the pool plays, and on which games
+	unsigned long long batchSeed;
+	std::atomic<int> next;
+	std::vector<std::thread> pool;
+	std::mutex mutex;
+	std::condition_variable wake, done;
+	unsigned int job;
+	int pending;
+	bool quit;
+};
+
+// Quadris.exe --tune <checkpoint> [generations] [population] [games] [max pieces] [width] [depth]
+// goes on from the checkpoint when it exists, its settings win over the ones given
+inline int tuneWeights(const char *path, int generations, int population, int games, int maxPieces, int width, int depth)
+{
+	Tuner tuner(population, games, maxPieces, width, depth);
+	FILE *f = fopen(path, "r");
+	if (f != NULL)
+	{
+		fclose(f);
+		if (!tuner.load(path))
+		{
+			printf("%s is not a tuner checkpoint\n", path);
+			return 1;
+		}
+		printf("resuming %s at generation %d\n", path, tuner.generation);
+	}
+	for (int g = 0; g < generations; g++)
+	{
+		double rate = tuner.evaluate(0);
+		tuner.breed();
+		Tuner::Individual &c = tuner.candidates.back();
+		printf("generation %d: champion %.1f lines per game (%.1f games/s) weights %.3f %.3f %.3f %.3f %.3f %.3f %.3f\n", tuner.generation, c.fitness, rate,
+			c.genes[0], c.genes[1], c.genes[2], c.genes[3], c.genes[4], c.genes[5], c.genes[6]);
+		if (!tuner.save(path))
+		{
+			printf("could not write %s\n", path);
+			return 1;
+		}
+	}
+	tuner.pick(0);
+	Tuner::Individual &b = tuner.best;
+	printf("best of %d candidates on the same games: %.1f lines per game, weights %.3f %.3f %.3f %.3f %.3f %.3f %.3f\n", (int)tuner.candidates.size(), b.fitness,
+		b.genes[0], b.genes[1], b.genes[2], b.genes[3], b.genes[4], b.genes[5], b.genes[6]);
+	if (!tuner.save(path))
+	{
+		printf("could not write %s\n", path);
+		return 1;
+	}
+	return 0;
+}
+
+#endif // !__tuner_h
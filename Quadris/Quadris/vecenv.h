@@ -0,0 +1,335 @@
+#ifndef __vecenv_h
+#define __vecenv_h
+
+#include "game.h"
+#include "movegen.h"
+#include "random.h"
+#include "trace.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// many headless games stepped together, for agents trained outside the game
+// the observations are written straight into buffers the caller owns, one row per game, nothing is copied twice
+// and a step allocates nothing: the games are made with the environment and a lost one is reset in place
+// actions are either one input per frame, with gravity every few frames, or the index of a placement of MoveGenerator,
+// whose cells are part of the observation
+// the games of a step are spread over a pool of threads
+class VectorEnv
+{
+public:
+	static const int LINES = 24;
+	static const int COLUMNS = 10;
+	static const int QUEUE = Game::PREVIEW + 1;
+	static const int MAX_PLACEMENTS = MoveGenerator::MAX_PLACEMENTS;
+	static const int NONE = (int)Replay::action::EXTENDED;		// frame action that only lets time go by
+	static const int CHUNK = 16;								// games a thread takes at a time
+
+	enum class mode { FRAME, PLACEMENT };
+
+	// any of them may be null, it is not written then
+	struct Buffers
+	{
+		unsigned char *board;			// LINES x COLUMNS per game, 1 filled, the falling piece not included
+		unsigned char *piece;			// 9 per game: the type, then line and column of the four blocks
+		unsigned char *queue;			// QUEUE per game: the types, the falling piece first
+		float *reward;					// points the step scored
+		unsigned char *done;			// 1 when the step lost the game, the observation is already the new game
+		int *placementCount;			// placement mode
+		unsigned char *placements;		// MAX_PLACEMENTS x 8 per game: line and column of the four blocks, placement mode
+	};
+
+	// gravity: a FALL every that many frames, 0 never; a FALL of gravity that finds the piece resting locks it
+	VectorEnv(int count, mode m, int threads = 1, int gravity = 0)
+	{
+		kind = m;
+		fallEvery = gravity;
+		memset(&buffers, 0, sizeof(buffers));
+		if (threads <= 0)
+			threads = (int)std::thread::hardware_concurrency();
+		if (threads <= 0)
+			threads = 1;
+		envs.resize(count < 1 ? 1 : count);
+		// a step before any reset plays these games
+		for (unsigned int i = 0; i < envs.size(); i++)
+		{
+			Env &e = envs[i];
+			e.seed = Game::newSeed();
+			e.frames = 0;
+			e.game = new Game(nullptr, e.seed);
+			e.generator = kind == mode::PLACEMENT ? new MoveGenerator() : nullptr;
+			if (e.generator != nullptr)
+				e.generator->generate(e.game->g);
+		}
+		actions = nullptr;
+		job = 0;
+		pending = 0;
+		quit = false;
+		for (int i = 1; i < threads; i++)
+			pool.push_back(std::thread(&VectorEnv::work, this));
+	}
+
+	~VectorEnv()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quit = true;
+		}
+		wake.notify_all();
+		for (unsigned int i = 0; i < pool.size(); i++)
+			pool[i].join();
+		for (unsigned int i = 0; i < envs.size(); i++)
+		{
+			delete envs[i].game;
+			delete envs[i].generator;
+		}
+	}
+
+	int size()
+	{
+		return (int)envs.size();
+	}
+
+	void setBuffers(const Buffers &b)
+	{
+		buffers = b;
+	}
+
+	// seeds: one per game, or null for random ones
+	void reset(const unsigned long long *s)
+	{
+		actions = nullptr;
+		seeds = s;
+		run();
+	}
+
+	// actions: one per game, frame inputs (Replay::action up to HARD_DROP, or NONE) or placement indices
+	void step(const int *a)
+	{
+		actions = a;
+		run();
+	}
+
+private:
+	struct Env
+	{
+		Game *game;
+		MoveGenerator *generator;
+		Replay::action inputs[MoveGenerator::MAX_INPUTS];
+		unsigned long long seed;
+		unsigned int frames;
+	};
+
+	// every thread takes chunks of games until none is left
+	void run()
+	{
+		TRACE_ZONE("VectorEnv::step");
+		next = 0;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			job++;
+			pending = (int)pool.size();
+		}
+		wake.notify_all();
+		chunks();
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			done.wait(lock, [this]() { return pending == 0; });
+		}
+	}
+
+	void work()
+	{
+		unsigned int seen = 0;
+		Trace::get().nameThread("env");
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [&]() { return quit || job != seen; });
+				if (quit)
+					return;
+				seen = job;
+			}
+			chunks();
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (--pending == 0)
+					done.notify_one();
+			}
+		}
+	}
+
+	void chunks()
+	{
+		TRACE_ZONE("VectorEnv::chunks");
+		int first, count = (int)envs.size();
+		while ((first = next.fetch_add(CHUNK)) < count)
+			for (int i = first; i < first + CHUNK && i < count; i++)
+			{
+				if (actions == nullptr)
+					restart(i, seeds != nullptr ? seeds[i] : Game::newSeed());
+				else
+					play(i, actions[i]);
+				observe(i);
+			}
+	}
+
+	void restart(int i, unsigned long long seed)
+	{
+		Env &e = envs[i];
+		e.game->reset(seed);
+		e.seed = seed;
+		e.frames = 0;
+		if (buffers.reward != nullptr)
+			buffers.reward[i] = 0.0f;
+		if (buffers.done != nullptr)
+			buffers.done[i] = 0;
+	}
+
+	void play(int i, int action)
+	{
+		Env &e = envs[i];
+		Grid *g = e.game->g;
+		float before = g->getPoints();
+		if (kind == mode::PLACEMENT)
+		{
+			// the placements are the ones of the last observation
+			if (e.generator->count > 0)
+			{
+				int n = e.generator->sequence(action >= 0 && action < e.generator->count ? action : 0, e.inputs);
+				for (int k = 0; k < n; k++)
+					e.game->execute(e.inputs[k], 1);
+			}
+		}
+		else
+		{
+			if (action >= 0 && action < NONE)
+				e.game->execute((Replay::action)action, 1);
+			if (fallEvery > 0 && ++e.frames % fallEvery == 0 && !g->lost)
+			{
+				e.game->execute(Replay::action::FALL, 1);
+				if (g->change)
+					e.game->execute(Replay::action::LOCK, 1);
+			}
+		}
+		float reward = g->getPoints() - before;
+		bool lost = g->lost || (kind == mode::PLACEMENT && e.generator->count == 0);
+		if (lost)
+			// the next game of this one follows from its seed, a run is the same every time
+			restart(i, e.seed * 6364136223846793005ULL + 1442695040888963407ULL);
+		if (buffers.reward != nullptr)
+			buffers.reward[i] = reward;
+		if (buffers.done != nullptr)
+			buffers.done[i] = lost ? 1 : 0;
+	}
+
+	void observe(int i)
+	{
+		Env &e = envs[i];
+		Grid *g = e.game->g;
+		if (buffers.board != nullptr)
+		{
+			unsigned short rows[Bitboard::LINES];
+			unsigned char *out = buffers.board + (size_t)i * LINES * COLUMNS;
+			g->getBoard(rows);
+			for (int l = 0; l < LINES; l++)
+				for (int c = 0; c < COLUMNS; c++)
+					*out++ = (unsigned char)((rows[l] >> c) & 1);
+		}
+		if (buffers.piece != nullptr)
+		{
+			int x[4], y[4];
+			unsigned char *out = buffers.piece + (size_t)i * 9;
+			g->getPiece(x, y);
+			*out++ = (unsigned char)g->getType();
+			for (int k = 0; k < 4; k++)
+			{
+				*out++ = (unsigned char)x[k];
+				*out++ = (unsigned char)y[k];
+			}
+		}
+		if (buffers.queue != nullptr)
+			for (int k = 0; k < QUEUE; k++)
+				buffers.queue[(size_t)i * QUEUE + k] = (unsigned char)e.game->queue[k]->type;
+		if (kind == mode::PLACEMENT)
+		{
+			int count = g->lost ? 0 : e.generator->generate(g);
+			if (buffers.placementCount != nullptr)
+				buffers.placementCount[i] = count;
+			if (buffers.placements != nullptr)
+			{
+				unsigned char *out = buffers.placements + (size_t)i * MAX_PLACEMENTS * 8;
+				for (int p = 0; p < count; p++)
+					for (int k = 0; k < 4; k++)
+					{
+						*out++ = (unsigned char)e.generator->placements[p].cells.x[k];
+						*out++ = (unsigned char)e.generator->placements[p].cells.y[k];
+					}
+			}
+		}
+	}
+
+	mode kind;
+	int fallEvery;
+	Buffers buffers;
+	std::vector<Env> envs;
+
+	// the step running, read by every thread
+	const int *actions;
+	const unsigned long long *seeds;
+	std::atomic<int> next;
+
+	std::vector<std::thread> pool;
+	std::mutex mutex;
+	std::condition_variable wake, done;
+	unsigned int job;
+	int pending;
+	bool quit;
+};
+
+// Quadris.exe --env [games] [steps] [threads] [placement actions 0/1]
+// random actions on every game, prints how many steps the environments take per second
+inline int benchmarkEnv(int games, int steps, int threads, int placements)
+{
+	VectorEnv env(games, placements ? VectorEnv::mode::PLACEMENT : VectorEnv::mode::FRAME, threads, 4);
+	std::vector<unsigned char> board((size_t)env.size() * VectorEnv::LINES * VectorEnv::COLUMNS), piece((size_t)env.size() * 9);
+	std::vector<unsigned char> queue((size_t)env.size() * VectorEnv::QUEUE), done(env.size());
+	std::vector<unsigned char> cells(placements ? (size_t)env.size() * VectorEnv::MAX_PLACEMENTS * 8 : 0);
+	std::vector<float> reward(env.size());
+	std::vector<int> count(env.size()), actions(env.size());
+	std::vector<unsigned long long> seeds(env.size());
+	VectorEnv::Buffers b = { board.data(), piece.data(), queue.data(), reward.data(), done.data(), count.data(), placements ? cells.data() : nullptr };
+	Random random(0xE2E2ULL);
+	long long lost = 0;
+	double points = 0.0;
+
+	for (int i = 0; i < env.size(); i++)
+		seeds[i] = 0xE0000000ULL + i;
+	env.setBuffers(b);
+	env.reset(seeds.data());
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int s = 0; s < steps; s++)
+	{
+		for (int i = 0; i < env.size(); i++)
+			actions[i] = placements ? (count[i] > 0 ? (int)(random() % count[i]) : 0) : (int)(random() % (VectorEnv::NONE + 1));
+		env.step(actions.data());
+		for (int i = 0; i < env.size(); i++)
+		{
+			lost += done[i];
+			points += reward[i];
+		}
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	printf("%d games, %d steps, %s actions: %.3f s, %.0f steps/s, %lld games lost, %.0f points\n", env.size(), steps, placements ? "placement" : "frame",
+		seconds, seconds > 0.0 ? (double)env.size() * steps / seconds : 0.0, lost, points);
+	return 0;
+}
+
+#endif // !__vecenv_h
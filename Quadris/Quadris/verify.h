@@ -0,0 +1,150 @@
+#ifndef __verify_h
+#define __verify_h
+
+#include "game.h"
+#include "replay.h"
+#include "scores.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+// re-simulates replays headless on every core and checks the points they claim
+// the points are recomputed from the lines each lock cleared with the lineComplete table,
+// so a replay only passes if its inputs really produce that score
+class ReplayVerifier
+{
+public:
+	enum class verdict { OK, MISMATCH, UNREADABLE, AFTER_GAME_OVER };
+
+	struct Result
+	{
+		std::string file;
+		verdict v;
+		int claimed, simulated, level;
+		char name[64];
+	};
+
+	static int pointsFor(int lines, int level)
+	{
+		static const int table[5] = { 0, 40, 100, 300, 1200 };
+		return lines >= 0 && lines <= 4 ? table[lines] * (level + 1) : 0;
+	}
+
+	static void verify(const std::string &path, Result *r)
+	{
+		Replay replay;
+		r->file = path;
+		r->claimed = r->simulated = 0;
+		r->name[0] = '\0';
+		if (!replay.load(path.c_str()))
+		{
+			r->v = verdict::UNREADABLE;
+			return;
+		}
+		memcpy(r->name, replay.name, 64);
+		r->claimed = replay.points;
+		r->level = replay.level;
+
+		Game game(nullptr, replay.seed, replay.level);
+		Replay::Reader reader(&replay);
+		Replay::Event e;
+		int points = 0;
+		bool over = false;
+		while (reader.next(&e))
+		{
+			if (game.g->lost)
+			{
+				over = true;
+				break;
+			}
+			game.execute(e.a, e.count);
+			points += pointsFor(game.linesCleared, game.g->getLevel());
+		}
+		r->simulated = points;
+		if (!reader.ok())
+			r->v = verdict::UNREADABLE;
+		else if (over)
+			r->v = verdict::AFTER_GAME_OVER;
+		else if (points != r->claimed || (int)game.g->getPoints() != points)
+			r->v = verdict::MISMATCH;
+		else
+			r->v = verdict::OK;
+	}
+
+	// threads <= 0 uses every core
+	static void verifyAll(const std::vector<std::string> &paths, std::vector<Result> *results, int threads)
+	{
+		std::atomic<size_t> next(0);
+		std::vector<std::thread> workers;
+		results->resize(paths.size());
+		if (threads <= 0)
+			threads = (int)std::thread::hardware_concurrency();
+		if (threads <= 0)
+			threads = 1;
+		for (int t = 0; t < threads; t++)
+			workers.push_back(std::thread([&]()
+			{
+				size_t i;
+				while ((i = next++) < paths.size())
+					verify(paths[i], &(*results)[i]);
+			}));
+		for (unsigned int t = 0; t < workers.size(); t++)
+			workers[t].join();
+	}
+};
+
+// Quadris.exe --verify <replay dir> [scores.sco]
+// prints every replay that fails and, with a score file, every score no verified replay backs
+inline int verifyReplays(const char *dir, const char *scores)
+{
+	std::vector<std::string> files, paths;
+	std::vector<ReplayVerifier::Result> results;
+	const char *verdicts[] = { "OK", "MISMATCH", "UNREADABLE", "AFTER_GAME_OVER" };
+	int failed = 0;
+
+	listReplays(dir, &files);
+	for (unsigned int i = 0; i < files.size(); i++)
+		paths.push_back(std::string(dir) + "/" + files[i]);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	ReplayVerifier::verifyAll(paths, &results, 0);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	for (unsigned int i = 0; i < results.size(); i++)
+		if (results[i].v != ReplayVerifier::verdict::OK)
+		{
+			failed++;
+			printf("%s %s %s claimed %d simulated %d\n", verdicts[(int)results[i].v], results[i].file.c_str(), results[i].name, results[i].claimed, results[i].simulated);
+		}
+
+	if (scores != nullptr)
+	{
+		std::ifstream sf;
+		char line[128];
+		sf.open(scores, std::ifstream::in);
+		while (sf.getline(line, 128))
+		{
+			ScoreRecord r;
+			bool backed = false;
+			if (!Leaderboard::parse(line, &r))
+				continue;
+			for (unsigned int i = 0; i < results.size() && !backed; i++)
+				backed = results[i].v == ReplayVerifier::verdict::OK && results[i].claimed == r.points && strcmp(results[i].name, r.name) == 0;
+			if (!backed)
+			{
+				failed++;
+				printf("UNBACKED %s;%d\n", r.name, r.points);
+			}
+		}
+		sf.close();
+	}
+
+	printf("%u replays verified in %.3f s (%.1f replays/s), %d problems\n", (unsigned int)results.size(), seconds, seconds > 0.0 ? results.size() / seconds : 0.0, failed);
+	return failed == 0 ? 0 : 1;
+}
+
+#endif // !__verify_h
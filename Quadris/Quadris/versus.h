@@ -0,0 +1,234 @@
+#ifndef __versus_h
+#define __versus_h
+
+#include "batch.h"
+#include "game.h"
+#include "latency.h"
+#include "random.h"
+#include "snapshot.h"
+#include "trace.h"
+
+// local two player versus on one keyboard: two headless games from the same seed, so both get the same pieces,
+// side by side on screen through one BoardBatch
+// lines cleared in one lock are sent to the other board as garbage (2 send 1, 3 send 2, a quadris sends 4);
+// garbage waits until the receiver locks a piece that clears nothing, lines the receiver clears first cancel it
+class Versus
+{
+public:
+	static const int PLAYERS = 2;
+	static const int MAX_PENDING = 8;				// garbage lines a board can have waiting
+	static constexpr double LOCK_DELAY = 0.6;		// seconds a piece rests on the stack, as in the single player game
+
+	// keys of one player, read with glfwGetKey every frame
+	struct Keys
+	{
+		int left, right, softDrop, hardDrop, rotateCW, rotateCCW;
+		const char *text;
+	};
+
+	struct Player
+	{
+		Game *game;
+		Keys keys;
+		bool released[5];			// left, right, hard drop, cw, ccw: a held key moves once
+		int time;					// the gravity step of the last fall, like fallTime of the single player game
+		int pending;				// garbage lines waiting for the next lock
+		int sent, wins;
+	};
+
+	Player players[PLAYERS];
+	int winner;						// -1 while the match runs or when both lost in the same frame
+	bool finished;
+
+	// Q W E / A S D on the left, U I O / J K L on the right
+	Versus()
+	{
+		Keys left = { GLFW_KEY_A, GLFW_KEY_D, GLFW_KEY_S, GLFW_KEY_W, GLFW_KEY_E, GLFW_KEY_Q, "A S D movem, W desce, Q E giram" };
+		Keys right = { GLFW_KEY_J, GLFW_KEY_L, GLFW_KEY_K, GLFW_KEY_I, GLFW_KEY_O, GLFW_KEY_U, "J K L movem, I desce, U O giram" };
+		players[0].keys = left;
+		players[1].keys = right;
+		for (int i = 0; i < PLAYERS; i++)
+		{
+			players[i].game = nullptr;
+			players[i].wins = 0;
+		}
+		winner = -1;
+		finished = true;
+	}
+
+	~Versus()
+	{
+		for (int i = 0; i < PLAYERS; i++)
+			delete players[i].game;
+	}
+
+	// a new match, the wins are kept; now in glfwGetTime seconds
+	void start(unsigned long long seed, int level, double now)
+	{
+		for (int i = 0; i < PLAYERS; i++)
+		{
+			Player &p = players[i];
+			delete p.game;
+			p.game = new Game(nullptr, seed, level);
+			p.game->g->ENDGAME = now;
+			p.time = (int)(p.game->g->scale * now);
+			p.pending = p.sent = 0;
+			// keys still down from the menu wait for their release
+			for (int k = 0; k < 5; k++)
+				p.released[k] = false;
+		}
+		holes.seed(seed ^ 0x9E3779B97F4A7C15ULL);
+		winner = -1;
+		finished = false;
+	}
+
+	// one frame of both games
+	void update(GLFWwindow *window, double frameTime, double now, InputLatency *latency)
+	{
+		TRACE_ZONE("Versus::update");
+		if (finished)
+			return;
+		for (int i = 0; i < PLAYERS; i++)
+			step(window, i, frameTime, now, latency);
+		bool lost[PLAYERS];
+		for (int i = 0; i < PLAYERS; i++)
+			lost[i] = players[i].game->g->lost;
+		if (lost[0] || lost[1])
+		{
+			finished = true;
+			winner = lost[0] && lost[1] ? -1 : (lost[0] ? 1 : 0);
+			if (winner >= 0)
+				players[winner].wins++;
+		}
+	}
+
+	// where board i goes, as the place of BoardBatch::add: side by side and a bit smaller than the single board
+	static glm::mat4 place(int i)
+	{
+		glm::mat4 m = glm::translate(glm::mat4(1.0f), glm::vec3(i == 0 ? -9.5f : 6.5f, 0.0f, 0.0f));
+		return glm::scale(m, glm::vec3(0.8f, 0.8f, 0.8f));
+	}
+
+	// both boards into batch, shown is scratch for the snapshots
+	void draw(BoardBatch *batch, Snapshot *shown)
+	{
+		batch->begin();
+		for (int i = 0; i < PLAYERS; i++)
+		{
+			players[i].game->snapshot(shown);
+			batch->add(*shown, place(i));
+		}
+		batch->draw();
+	}
+
+private:
+	// the lines sent by a lock that cleared lines
+	static int attack(int lines)
+	{
+		return lines >= 4 ? 4 : (lines > 0 ? lines - 1 : 0);
+	}
+
+	// true on the frame the key goes down
+	static bool pressed(GLFWwindow *window, int key, bool *released)
+	{
+		if (glfwGetKey(window, key) == GLFW_RELEASE)
+		{
+			*released = true;
+			return false;
+		}
+		if (!*released)
+			return false;
+		*released = false;
+		return true;
+	}
+
+	// a move asked by a key, measured like applyKey of the single player game
+	static void move(Game *game, Replay::action a, int key, double now, InputLatency *latency)
+	{
+		unsigned long long before = game->g->getHash();
+		game->apply(a);
+		if (latency != nullptr)
+			latency->consumed(key, game->g->getHash() != before, now);
+		game->g->ENDGAME = now;
+	}
+
+	// input, lock and gravity of one board, the same rules as the single player loop
+	void step(GLFWwindow *window, int i, double frameTime, double now, InputLatency *latency)
+	{
+		Player &p = players[i];
+		Game *game = p.game;
+		Grid *g = game->g;
+		game->clock += frameTime;
+
+		if (pressed(window, p.keys.left, &p.released[0]))
+			move(game, Replay::action::LEFT, p.keys.left, now, latency);
+		if (pressed(window, p.keys.right, &p.released[1]))
+			move(game, Replay::action::RIGHT, p.keys.right, now, latency);
+		if (pressed(window, p.keys.rotateCW, &p.released[3]))
+			move(game, Replay::action::ROTATE_CW, p.keys.rotateCW, now, latency);
+		if (pressed(window, p.keys.rotateCCW, &p.released[4]))
+			move(game, Replay::action::ROTATE_CCW, p.keys.rotateCCW, now, latency);
+		if (glfwGetKey(window, p.keys.softDrop) == GLFW_PRESS)
+		{
+			if (g->scale != g->fastScale)
+				game->softDrop(true);
+			g->scale = g->fastScale;
+		}
+		else
+		{
+			if (g->scale == g->fastScale)
+			{
+				g->scaleBack = true;
+				game->softDrop(false);
+			}
+			g->scale = g->normalScale;
+		}
+
+		bool drop = pressed(window, p.keys.hardDrop, &p.released[2]);
+		if ((g->endgame && g->change && now - g->ENDGAME >= LOCK_DELAY) || drop)
+		{
+			unsigned long long before = g->getHash();
+			game->apply(drop ? Replay::action::HARD_DROP : Replay::action::LOCK);
+			if (drop && latency != nullptr)
+				latency->consumed(p.keys.hardDrop, g->getHash() != before, now);
+			locked(i);
+			p.time = (int)(g->scale * now);
+		}
+
+		if (!g->endgame && g->change)
+		{
+			g->ENDGAME = now;
+			g->endgame = true;
+		}
+		else if (g->endgame && !g->change)
+			g->endgame = false;
+
+		if (!g->lost && ((int)(g->scale * now) > p.time || g->scaleBack))
+		{
+			g->scaleBack = false;
+			p.time = (int)(g->scale * now);
+			game->apply(Replay::action::FALL);
+		}
+	}
+
+	// after a lock of player i: its lines cancel what it has waiting, the rest goes to the other board
+	void locked(int i)
+	{
+		Player &p = players[i], &other = players[1 - i];
+		int lines = p.game->linesCleared, sent = attack(lines);
+		int cancelled = sent < p.pending ? sent : p.pending;
+		p.pending -= cancelled;
+		sent -= cancelled;
+		p.sent += sent;
+		other.pending = other.pending + sent < MAX_PENDING ? other.pending + sent : MAX_PENDING;
+		if (lines == 0 && p.pending > 0 && !p.game->g->lost)
+		{
+			p.game->g->addGarbage(p.pending, (int)(holes() % 10));
+			p.pending = 0;
+		}
+	}
+
+	Random holes;					// the column left open in each batch of garbage
+};
+
+#endif // !__versus_h
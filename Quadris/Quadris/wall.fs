@@ -0,0 +1,24 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 Cell;
+flat in int Layer;
+
+// one layer per board, one texel per cell: its color, alpha 1 for a block, 0.5 for an empty cell, 0 around the board
+uniform sampler2DArray boards;
+// texture samplers
+uniform sampler2D text1;
+uniform sampler2D text2;
+
+void main()
+{
+	vec4 cell = texelFetch(boards, ivec3(ivec2(Cell), Layer), 0);
+	if(cell.a < 0.25)
+		discard;
+	// the gradients of Cell, fract would make every cell edge pick the smallest mipmap
+	vec2 uv = vec2(fract(Cell.x), 1.0 - fract(Cell.y));
+	if(cell.a > 0.75)
+		FragColor = mix(textureGrad(text1, uv, dFdx(Cell), dFdy(Cell)), vec4(cell.rgb, 1.0f), 0.5);
+	else
+		FragColor = textureGrad(text2, uv, dFdx(Cell), dFdy(Cell));
+}
\ No newline at end of file
@@ -0,0 +1,205 @@
+#ifndef __wall_h
+#define __wall_h
+
+#include "shader_s.h"
+#include "batch.h"
+#include "grid.h"
+#include "pieces.h"
+#include "snapshot.h"
+#include "trace.h"
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+// what the wall shows of one board, small enough to be copied for every board every frame
+struct WallTile
+{
+	unsigned char cells[Snapshot::LINES * Snapshot::COLUMNS / 2];		// packed as in Snapshot, the falling piece in them
+	unsigned char next;													// Piece::types of the next piece
+
+	int getCell(int l, int c) const
+	{
+		int i = l * Snapshot::COLUMNS + c;
+		return (cells[i >> 1] >> ((i & 1) * 4)) & 0xF;
+	}
+};
+
+// where n boards go on a screen of aspect width / height, as fractions of the screen from its top left corner
+// the grid of boards is the one where they come out the biggest, a label goes over each board
+struct WallLayout
+{
+	static constexpr float BOARD_W = 16.0f, BOARD_H = 20.0f, LABEL_H = 3.0f;		// in cells
+	static constexpr float MARGIN = 1.1f;
+
+	int columns, rows;
+	float tileW, tileH;			// from a board to the next
+	float boardW, boardH, labelH;
+
+	static WallLayout fit(int n, float aspect)
+	{
+		WallLayout l;
+		float best = 0.0f;
+		l.columns = l.rows = 1;
+		for (int c = 1; c <= n; c++)
+		{
+			int r = (n + c - 1) / c;
+			float across = aspect / (c * BOARD_W * MARGIN), down = 1.0f / (r * (BOARD_H + LABEL_H) * MARGIN);
+			float cell = across < down ? across : down;
+			if (cell > best)
+			{
+				best = cell;
+				l.columns = c;
+				l.rows = r;
+			}
+		}
+		l.tileW = 1.0f / l.columns;
+		l.tileH = 1.0f / l.rows;
+		l.boardW = best * BOARD_W / aspect;
+		l.boardH = best * BOARD_H;
+		l.labelH = best * LABEL_H;
+		return l;
+	}
+
+	// top left corner of board i, its label is right above
+	float x(int i) const
+	{
+		return (i % columns) * tileW + (tileW - boardW) / 2.0f;
+	}
+
+	float y(int i) const
+	{
+		return (i / columns) * tileH + (tileH - boardH - labelH) / 2.0f + labelH;
+	}
+};
+
+// draws any number of boards with a single instanced draw: each board is a layer of one texture array,
+// a texel per cell, and only the layers of the boards that changed since the last frame are uploaded
+// so what a frame costs on the CPU is a memcmp of each tile, not a draw call or an instance per cell
+class BoardWall
+{
+public:
+	static const int WIDTH = 16, HEIGHT = 20;		// texels of a layer: the 20 lines on screen, a gap, the next piece
+
+	// with the GL context current
+	BoardWall() : shader("wall.vs", "wall.fs")
+	{
+		for (int t = 0; t < 7; t++)
+		{
+			Piece p((Piece::types)t, Piece::rotation::R0);
+			for (int i = 0; i < 4; i++)
+				shapes[t][i] = p.positions[i];
+		}
+		layers = 0;
+		glGenVertexArrays(1, &vao);
+		glGenTextures(1, &boards);
+		text1 = Piece::loadTexture();
+		text2 = BoardBatch::loadTexture("resources/textures/transparent.jpg");
+
+		int previous;
+		glGetIntegerv(GL_CURRENT_PROGRAM, &previous);
+		shader.use();
+		shader.setInt("text1", 0);
+		shader.setInt("text2", 1);
+		shader.setInt("boards", 2);
+		shader.setVec2("cells", (float)WIDTH, (float)HEIGHT);
+		glUseProgram(previous);
+	}
+
+	~BoardWall()
+	{
+		glDeleteVertexArrays(1, &vao);
+		glDeleteTextures(1, &boards);
+		glDeleteTextures(1, &text2);
+		glDeleteProgram(shader.ID);
+	}
+
+	// the n boards of tiles on a framebuffer of width x height, the program bound before is bound again after
+	void draw(const WallTile *tiles, int n, int width, int height)
+	{
+		TRACE_ZONE("BoardWall::draw");
+		if (n <= 0 || width <= 0 || height <= 0)
+			return;
+		glActiveTexture(GL_TEXTURE2);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, boards);
+		if (n > layers)
+			allocate(n);
+		for (int i = 0; i < n; i++)
+			if (memcmp(&tiles[i], &shown[i], sizeof(WallTile)) != 0)
+			{
+				shown[i] = tiles[i];
+				encode(tiles[i]);
+				glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, WIDTH, HEIGHT, 1, GL_RGBA, GL_UNSIGNED_BYTE, texels);
+			}
+
+		// fractions of the screen from the top left to NDC
+		WallLayout l = WallLayout::fit(n, (float)width / height);
+		int previous;
+		glGetIntegerv(GL_CURRENT_PROGRAM, &previous);
+		shader.use();
+		shader.setInt("columns", l.columns);
+		shader.setVec2("origin", -1.0f + 2.0f * l.x(0), 1.0f - 2.0f * (l.y(0) + l.boardH));
+		shader.setVec2("pitch", 2.0f * l.tileW, 2.0f * l.tileH);
+		shader.setVec2("size", 2.0f * l.boardW, 2.0f * l.boardH);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, text1);
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, text2);
+		glBindVertexArray(vao);
+		glDrawArraysInstanced(GL_TRIANGLES, 0, 6, n);
+		glBindVertexArray(0);
+		glUseProgram(previous);
+	}
+
+private:
+	// room for n layers, every board is uploaded again
+	void allocate(int n)
+	{
+		layers = n;
+		shown.assign(n, WallTile());
+		for (int i = 0; i < n; i++)
+			shown[i].next = 0xFF;
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, WIDTH, HEIGHT, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+	}
+
+	void texel(int x, int y, glm::vec3 color, unsigned char alpha)
+	{
+		unsigned char *t = &texels[(y * WIDTH + x) * 4];
+		t[0] = (unsigned char)(color.r * 255.0f);
+		t[1] = (unsigned char)(color.g * 255.0f);
+		t[2] = (unsigned char)(color.b * 255.0f);
+		t[3] = alpha;
+	}
+
+	// the board on the left, the next piece on the right where the preview of the game is
+	void encode(const WallTile &t)
+	{
+		memset(texels, 0, sizeof(texels));
+		for (int l = 0; l < HEIGHT; l++)
+			for (int c = 0; c < Snapshot::COLUMNS; c++)
+			{
+				int kind = t.getCell(l, c);
+				if (kind == Snapshot::GARBAGE)
+					texel(c, l, Grid::garbageColor(), 255);
+				else if (kind != 0)
+					texel(c, l, Piece::colorOf((Piece::types)(kind - 1)), 255);
+				else
+					texel(c, l, glm::vec3(0.0f), 128);
+			}
+		if (t.next < 7)
+			for (int i = 0; i < 4; i++)
+				texel(12 + (int)floor(shapes[t.next][i].x + 0.5f), 16 + (int)floor(shapes[t.next][i].y), Piece::colorOf((Piece::types)t.next), 255);
+	}
+
+	Shader shader;
+	unsigned int vao, boards, text1, text2;		// the vertex array is empty, core profile still wants one bound
+	int layers;
+	std::vector<WallTile> shown;				// what each layer holds
+	unsigned char texels[WIDTH * HEIGHT * 4];
+	glm::vec3 shapes[7][4];
+};
+
+#endif // !__wall_h
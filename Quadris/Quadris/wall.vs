@@ -0,0 +1,21 @@
+#version 330 core
+// no vertex buffer: the corners of a board come from gl_VertexID, its place on the wall from gl_InstanceID
+out vec2 Cell;
+flat out int Layer;
+
+uniform int columns;
+uniform vec2 origin;		// bottom left corner of the first board, top left of the wall
+uniform vec2 pitch;			// from a board to the next one on the right and below
+uniform vec2 size;
+uniform vec2 cells;			// texels of a layer
+
+const vec2 corners[6] = vec2[6](vec2(1.0, 1.0), vec2(1.0, 0.0), vec2(0.0, 0.0), vec2(0.0, 0.0), vec2(0.0, 1.0), vec2(1.0, 1.0));
+
+void main()
+{
+	vec2 corner = corners[gl_VertexID];
+	vec2 tile = vec2(gl_InstanceID % columns, -(gl_InstanceID / columns));
+	gl_Position = vec4(origin + tile * pitch + corner * size, 0.0, 1.0);
+	Cell = corner * cells;
+	Layer = gl_InstanceID;
+}
\ No newline at end of file
@@ -0,0 +1,156 @@
+#ifndef __zobrist_h
+#define __zobrist_h
+
+#include "random.h"
+
+#include <atomic>
+#include <cstring>
+
+// random keys to hash a position by xor: one per cell, one per piece type and one per place in the queue
+// filling or clearing a cell is one xor, so the hash is kept up to date instead of recomputed
+class Zobrist
+{
+public:
+	static const int LINES = 28;
+	static const int QUEUE = 64;			// pieces counted from the start of the game, wraps around
+
+	unsigned long long cell[LINES][10], piece[7], queue[QUEUE];
+
+	static const Zobrist& keys()
+	{
+		static Zobrist z;
+		return z;
+	}
+
+private:
+	Zobrist()
+	{
+		Random random(0x2B0B157ULL);
+		for (int l = 0; l < LINES; l++)
+			for (int c = 0; c < 10; c++)
+				cell[l][c] = next(&random);
+		for (int t = 0; t < 7; t++)
+			piece[t] = next(&random);
+		for (int q = 0; q < QUEUE; q++)
+			queue[q] = next(&random);
+	}
+
+	static unsigned long long next(Random *random)
+	{
+		unsigned long long high = (*random)();
+		return (high << 32) | (*random)();
+	}
+};
+
+// fixed size table of search results shared by every search thread without locks
+// each entry is two atomic words, check = key ^ data: a torn write leaves check ^ data != key and reads as a miss
+// buckets of four entries, a new result replaces an entry of an older search first and then the shallowest one
+class TranspositionTable
+{
+public:
+	static const int BUCKET = 4;
+
+	struct Result
+	{
+		float value;
+		int depth;
+		bool current;			// stored by this search, not an older one
+	};
+
+	TranspositionTable(int bits = 18)
+	{
+		size = (size_t)1 << bits;
+		entries = new Entry[size * BUCKET];
+		age = 0;
+		clear();
+	}
+
+	~TranspositionTable()
+	{
+		delete[] entries;
+	}
+
+	void clear()
+	{
+		for (size_t i = 0; i < size * BUCKET; i++)
+		{
+			entries[i].check.store(0, std::memory_order_relaxed);
+			entries[i].data.store(0, std::memory_order_relaxed);
+		}
+	}
+
+	// called once per search, ages everything already stored
+	// the age is 8 bits: when it comes back to 0 what is left from 256 searches ago would read as current, so it goes
+	void newSearch()
+	{
+		age = (age + 1) & 0xFF;
+		if (age == 0)
+			clear();
+	}
+
+	bool probe(unsigned long long key, Result *r)
+	{
+		Entry *bucket = &entries[(key & (size - 1)) * BUCKET];
+		for (int i = 0; i < BUCKET; i++)
+		{
+			unsigned long long data = bucket[i].data.load(std::memory_order_relaxed);
+			if ((bucket[i].check.load(std::memory_order_relaxed) ^ data) == key && data != 0)
+			{
+				r->value = valueOf(data);
+				r->depth = (int)((data >> 32) & 0xFF);
+				r->current = ((data >> 40) & 0xFF) == age;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void store(unsigned long long key, float value, int depth)
+	{
+		Entry *bucket = &entries[(key & (size - 1)) * BUCKET], *victim = bucket;
+		int worst = 1 << 30;
+		for (int i = 0; i < BUCKET; i++)
+		{
+			unsigned long long data = bucket[i].data.load(std::memory_order_relaxed);
+			int d = (int)((data >> 32) & 0xFF), score = d;
+			if ((bucket[i].check.load(std::memory_order_relaxed) ^ data) == key)
+			{
+				victim = &bucket[i];
+				break;
+			}
+			// old searches go first, among the same search the shallowest
+			if (((data >> 40) & 0xFF) != age)
+				score -= 256;
+			if (score < worst)
+			{
+				worst = score;
+				victim = &bucket[i];
+			}
+		}
+		unsigned int bits;
+		memcpy(&bits, &value, sizeof(bits));
+		unsigned long long data = bits | ((unsigned long long)(depth & 0xFF) << 32) | ((unsigned long long)age << 40) | (1ULL << 48);
+		victim->check.store(key ^ data, std::memory_order_relaxed);
+		victim->data.store(data, std::memory_order_relaxed);
+	}
+
+private:
+	struct Entry
+	{
+		std::atomic<unsigned long long> check, data;
+	};
+
+	static float valueOf(unsigned long long data)
+	{
+		unsigned int bits = (unsigned int)data;
+		float value;
+		memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+	Entry *entries;
+	size_t size;
+	unsigned int age;
+};
+
+#endif // !__zobrist_h